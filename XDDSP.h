@@ -18,7 +18,10 @@
 #include "XDDSP_Noise.h"
 #include "XDDSP_Mixing.h"
 #include "XDDSP_Filters.h"
+#include "XDDSP_FrequencyResponse.h"
+#include "XDDSP_Resampler.h"
 #include "XDDSP_Delay.h"
+#include "XDDSP_Reverb.h"
 #include "XDDSP_Waveshaper.h"
 #include "XDDSP_Oscillators.h"
 #include "XDDSP_PiecewiseEnvelopeData.h"
@@ -26,6 +29,7 @@
 #include "XDDSP_FIRImpulses.h"
 #include "XDDSP_WindowFunctions.h"
 #include "XDDSP_FFT.h"
+#include "XDDSP_Wavetable.h"
 #include "XDDSP_Analysis.h"
 #include "XDDSP_Polyphony.h"
 #include "XDDSP_Global.h"
@@ -14,6 +14,11 @@
 #include "XDDSP_Types.h"
 #include "XDDSP_Functions.h"
 #include "XDDSP_Parameters.h"
+#include "XDDSP_WindowFunctions.h"
+#include "XDDSP_FFT.h"
+#include <atomic>
+#include <thread>
+#include <memory>
 
 
 
@@ -203,6 +208,611 @@ public:
 
 
 
+/**
+ * @brief A frame of spectrum analysis data read from a SpectrumAnalyser.
+ * 
+ */
+struct SpectrumFrame
+{
+ /// The centre frequency of each bin in Hz.
+ std::vector<SampleType> frequency;
+ 
+ /// The averaged magnitude of each bin, where a full scale sine wave has a magnitude of 1.
+ std::vector<SampleType> average;
+ 
+ /// The peak magnitude of each bin, held and released over the peak hold time.
+ std::vector<SampleType> peak;
+ 
+ /// The number of frames the analyser had produced when this frame was produced.
+ uint64_t frameNumber {0};
+};
+
+
+
+
+
+
+
+
+
+
+/**
+ * @brief A spectrum analyser component for user interfaces, which never blocks the audio thread.
+ * 
+ * The input channels are averaged and written into a buffer without locking. Every hop, the latest Size samples are windowed and transformed, and the magnitude of each bin is averaged and peak held. This work happens either on the audio thread, at the rate set by the hop size, or on a worker thread owned by the component. Each finished frame is published through a triple buffer, so the interface thread can read the latest frame at any time with getLatestFrame, without waiting for the analysis and without ever making the analysis wait.
+ * 
+ * Frames can be read with linear frequency bins, one for each FFT bin, or grouped into logarithmically spaced bands.
+ * 
+ * @tparam SignalIn Couples to the signal to analyse. Can have as many channels as you like.
+ * @tparam Size The length of the FFT. Must be a power of 2. The default is 2048.
+ */
+template <typename SignalIn, int Size = 2048>
+class SpectrumAnalyser : public Component<SpectrumAnalyser<SignalIn, Size>>, public Parameters::ParameterListener
+{
+ static_assert(Size >= 4 && (Size & (Size - 1)) == 0, "SpectrumAnalyser: Size must be a power of 2");
+ 
+ static constexpr int Bins = Size/2 + 1;
+ static constexpr int NewFrameBit = 4;
+ static constexpr int IndexMask = 3;
+ 
+ struct PublishedFrame
+ {
+  std::vector<SampleType> average;
+  std::vector<SampleType> peak;
+  uint64_t frameNumber {0};
+ };
+ 
+ Parameters &dspParam;
+ 
+ // Written only by the audio thread. The samples are relaxed atomics so that they can be read while they are written, which costs nothing on common hardware.
+ std::unique_ptr<std::atomic<SampleType>[]> ring;
+ PowerSize ringSize;
+ std::atomic<uint64_t> written {0};
+ 
+ // Set by reset, and cleared by whichever thread next analyses
+ std::atomic<bool> resetPending {false};
+ 
+ // Owned by whichever thread holds the analysing flag
+ std::atomic_flag analysing = ATOMIC_FLAG_INIT;
+ FFTPlan plan;
+ std::vector<SampleType> window;
+ std::vector<SampleType> frame;
+ std::vector<SampleType> average;
+ std::vector<SampleType> peak;
+ uint64_t analysedTo {0};
+ uint64_t frameCount {0};
+ 
+ // Settings which may be changed from any thread
+ std::atomic<int> hop {Size/4};
+ std::atomic<SampleType> averagingTime {0.1};
+ std::atomic<SampleType> peakHoldTime {1.};
+ 
+ // The triple buffer
+ std::array<PublishedFrame, 3> frames;
+ std::atomic<int> middle {1};
+ int back {0};
+ int front {2};
+ 
+ // Owned by the reading thread
+ int logBands {0};
+ SampleType logMinimum {20.};
+ SampleType logMaximum {20000.};
+ 
+ std::atomic<bool> workerRunning {false};
+ std::thread worker;
+ 
+ // Analyse every complete hop. Returns without doing anything if another thread is already analysing.
+ void analysePending()
+ {
+  if (analysing.test_and_set(std::memory_order_acquire)) return;
+  
+  if (resetPending.exchange(false, std::memory_order_acquire))
+  {
+   std::fill(average.begin(), average.end(), 0.);
+   std::fill(peak.begin(), peak.end(), 0.);
+   analysedTo = written.load(std::memory_order_acquire);
+  }
+  
+  const uint64_t available = written.load(std::memory_order_acquire);
+  const uint64_t h = hop.load(std::memory_order_relaxed);
+  
+  // If the analysis has fallen far behind, skip to the latest frames
+  if (available - analysedTo > ringSize.size()/2 - Size) analysedTo = available - h;
+  
+  while (available - analysedTo >= h)
+  {
+   analysedTo += h;
+   if (!analyseFrame(analysedTo, h)) break;
+  }
+  
+  analysing.clear(std::memory_order_release);
+ }
+ 
+ // Analyse the frame ending at a position in the buffer. Returns false if the audio thread overwrote the frame while it was being read.
+ bool analyseFrame(uint64_t end, uint64_t h)
+ {
+  const uint64_t start = end - Size;
+  for (int n = 0; n < Size; ++n)
+  {
+   frame[n] = ring[(start + n) & ringSize.mask()].load(std::memory_order_relaxed)*window[n];
+  }
+  if (written.load(std::memory_order_acquire) - start > ringSize.size()) return false;
+  plan.forward(frame.data(), false);
+  
+  const SampleType hopTime = h*dspParam.sampleInterval();
+  const SampleType avgTime = averagingTime.load(std::memory_order_relaxed);
+  const SampleType holdTime = peakHoldTime.load(std::memory_order_relaxed);
+  const SampleType avgCoef = avgTime > 0. ? std::exp(-hopTime/avgTime) : 0.;
+  const SampleType peakCoef = holdTime > 0. ? std::exp(-hopTime/holdTime) : 0.;
+  
+  for (int k = 0; k < Bins; ++k)
+  {
+   const SampleType re = frame[k];
+   const SampleType im = (k == 0 || k == Size/2) ? 0. : frame[Size - k];
+   const SampleType mag = std::sqrt(re*re + im*im);
+   expTrack(average[k], mag, avgCoef);
+   peak[k] = std::max(mag, peak[k]*peakCoef);
+  }
+  ++frameCount;
+  
+  PublishedFrame &f = frames[back];
+  std::copy(average.begin(), average.end(), f.average.begin());
+  std::copy(peak.begin(), peak.end(), f.peak.begin());
+  f.frameNumber = frameCount;
+  back = middle.exchange(back | NewFrameBit, std::memory_order_acq_rel) & IndexMask;
+  return true;
+ }
+ 
+ void workerLoop()
+ {
+  while (workerRunning.load(std::memory_order_acquire))
+  {
+   analysePending();
+   
+   // Wake a few times per hop so frames are published soon after they are complete
+   const double hopSeconds = hop.load(std::memory_order_relaxed)*dspParam.sampleInterval();
+   std::this_thread::sleep_for(std::chrono::duration<double>(std::max(0.001, hopSeconds/4.)));
+  }
+ }
+ 
+public:
+ static constexpr int Count = SignalIn::Count;
+ 
+ SignalIn signalIn;
+ 
+ SpectrumAnalyser(Parameters &p, SignalIn _signalIn) :
+ Parameters::ParameterListener(p),
+ dspParam(p),
+ plan(Size),
+ window(Size),
+ frame(Size),
+ average(Bins, 0.),
+ peak(Bins, 0.),
+ signalIn(_signalIn)
+ {
+  // Scale the window so that a full scale sine wave has a magnitude of one
+  std::fill(window.begin(), window.end(), 1.);
+  applyWindowFunction(WindowFunction::Hann(Size), window.data(), Size);
+  const SampleType windowSum = std::accumulate(window.begin(), window.end(), 0.);
+  for (auto &w : window) w *= 2./windowSum;
+  
+  ringSize.setToNextPowerTwo(4*Size);
+  ring.reset(new std::atomic<SampleType>[ringSize.size()]);
+  for (uint32_t i = 0; i < ringSize.size(); ++i) ring[i].store(0., std::memory_order_relaxed);
+  for (auto &f : frames)
+  {
+   f.average.assign(Bins, 0.);
+   f.peak.assign(Bins, 0.);
+  }
+ }
+ 
+ ~SpectrumAnalyser()
+ {
+  setWorkerThread(false);
+ }
+ 
+ void reset()
+ {
+  // The analysis state may belong to the worker thread, so it is cleared by whichever thread analyses next
+  for (uint32_t i = 0; i < ringSize.size(); ++i) ring[i].store(0., std::memory_order_relaxed);
+  written.store(0, std::memory_order_release);
+  resetPending.store(true, std::memory_order_release);
+ }
+ 
+ /**
+  * @brief Choose whether the analysis runs on a worker thread or on the audio thread.
+  * 
+  * With the worker thread disabled, which is the default, the audio thread analyses one frame every hop. With it enabled, the audio thread only copies samples and a thread owned by the component does the analysis. This must not be called from the audio thread.
+  * 
+  * @param enabled True to analyse on a worker thread.
+  */
+ void setWorkerThread(bool enabled)
+ {
+  if (enabled == workerRunning.load()) return;
+  if (enabled)
+  {
+   workerRunning = true;
+   worker = std::thread([this]() { workerLoop(); });
+  }
+  else
+  {
+   workerRunning = false;
+   if (worker.joinable()) worker.join();
+  }
+ }
+ 
+ /**
+  * @brief Set the number of samples between frames.
+  * 
+  * Larger hops reduce the cost of the analysis and the frame rate. The default is a quarter of the FFT size.
+  * 
+  * @param samples The number of samples between frames, between 1 and the FFT size.
+  */
+ void setHopSize(int samples)
+ { hop = std::max(1, std::min(Size, samples)); }
+ 
+ /**
+  * @brief Set the time constant of the averaged magnitudes.
+  * 
+  * @param seconds The time constant in seconds. Zero disables averaging. The default is 0.1 seconds.
+  */
+ void setAveragingTime(SampleType seconds)
+ { averagingTime = seconds; }
+ 
+ /**
+  * @brief Set the time constant over which held peaks are released.
+  * 
+  * @param seconds The time constant in seconds. Zero disables peak hold. The default is 1 second.
+  */
+ void setPeakHoldTime(SampleType seconds)
+ { peakHoldTime = seconds; }
+ 
+ /**
+  * @brief Group the bins of frames read by getLatestFrame into logarithmically spaced bands.
+  * 
+  * Each band reports the mean of the averaged magnitudes and the maximum of the peak magnitudes of the bins it covers. Bands which are narrower than one bin use the nearest bin. This must be called from the thread which calls getLatestFrame.
+  * 
+  * @param bands The number of bands.
+  * @param minimumFrequency The lower edge of the lowest band in Hz.
+  * @param maximumFrequency The upper edge of the highest band in Hz.
+  */
+ void setLogBinning(int bands, SampleType minimumFrequency, SampleType maximumFrequency)
+ {
+  logBands = std::max(1, bands);
+  logMinimum = std::max(minimumFrequency, static_cast<SampleType>(1e-3));
+  logMaximum = std::max(maximumFrequency, logMinimum);
+ }
+ 
+ /**
+  * @brief Read frames with one linear frequency bin for each FFT bin, which is the default.
+  * 
+  * This must be called from the thread which calls getLatestFrame.
+  */
+ void setLinearBinning()
+ { logBands = 0; }
+ 
+ /**
+  * @brief Read the latest frame of analysis data.
+  * 
+  * This never blocks and never makes the analysis wait. Only one thread may read frames. The vectors in the frame are resized as needed, which may allocate memory.
+  * 
+  * @param result The frame to write the data into.
+  * @return true If a new frame has been produced since the last call.
+  * @return false If the frame is the same as the last call.
+  */
+ bool getLatestFrame(SpectrumFrame &result)
+ {
+  const bool fresh = (middle.load(std::memory_order_acquire) & NewFrameBit) != 0;
+  if (fresh) front = middle.exchange(front, std::memory_order_acq_rel) & IndexMask;
+  const PublishedFrame &f = frames[front];
+  const SampleType binWidth = dspParam.sampleRate()/Size;
+  result.frameNumber = f.frameNumber;
+  
+  if (logBands == 0)
+  {
+   result.frequency.resize(Bins);
+   for (int k = 0; k < Bins; ++k) result.frequency[k] = k*binWidth;
+   result.average = f.average;
+   result.peak = f.peak;
+   return fresh;
+  }
+  
+  result.frequency.resize(logBands);
+  result.average.resize(logBands);
+  result.peak.resize(logBands);
+  const SampleType ratio = std::pow(logMaximum/logMinimum, static_cast<SampleType>(1.)/logBands);
+  SampleType lower = logMinimum;
+  for (int b = 0; b < logBands; ++b)
+  {
+   const SampleType upper = lower*ratio;
+   result.frequency[b] = std::sqrt(lower*upper);
+   int first = std::min(Bins - 1, static_cast<int>(std::ceil(lower/binWidth)));
+   int last = std::min(Bins - 1, static_cast<int>(std::floor(upper/binWidth)));
+   if (last < first) first = last = std::min(Bins - 1, static_cast<int>(std::round(result.frequency[b]/binWidth)));
+   
+   SampleType sum = 0.;
+   SampleType max = 0.;
+   for (int k = first; k <= last; ++k)
+   {
+    sum += f.average[k];
+    max = std::max(max, f.peak[k]);
+   }
+   result.average[b] = sum/(last - first + 1);
+   result.peak[b] = max;
+   lower = upper;
+  }
+  return fresh;
+ }
+ 
+ void stepProcess(int startPoint, int sampleCount)
+ {
+  const SampleType scale = 1./Count;
+  uint64_t w = written.load(std::memory_order_relaxed);
+  for (int i = startPoint, s = sampleCount; s--; ++i, ++w)
+  {
+   SampleType x = 0.;
+   for (int c = 0; c < Count; ++c) x += signalIn(c, i);
+   ring[w & ringSize.mask()].store(x*scale, std::memory_order_relaxed);
+  }
+  written.store(w, std::memory_order_release);
+  
+  if (!workerRunning.load(std::memory_order_relaxed)) analysePending();
+ }
+};
+
+
+
+
+
+
+
+
+
+
+/**
+ * @brief A streaming pitch detector for monophonic signals such as voices and solo instruments.
+ * 
+ * Each channel is tracked independently using the McLeod pitch method. Every hop, the normalised square difference function of the latest WindowSize samples is calculated with an FFT of twice the window size, which is the autocorrelation based form of the YIN difference function. The first peak in that function which comes close to the highest peak gives the period, refined with parabolic interpolation. The height of the peak, between 0 and 1, is the clarity of the pitch.
+ * 
+ * The channels analyse on staggered hops, so that with many channels the cost is spread evenly over the hop rather than falling on one sample. All memory is allocated when the component is constructed.
+ * 
+ * The outputs hold their values between hops. When the signal is below the silence threshold, or no pitch is found, the clarity output is 0 and the frequency output holds the last pitch found. Each estimate describes the window which ends at the current sample, so its centre is WindowSize/2 samples in the past.
+ * 
+ * @tparam SignalIn Couples to the signal to analyse.
+ * @tparam WindowSize The number of samples analysed every hop. Must be a power of 2. The period of the lowest detectable pitch is half of this. The default is 2048.
+ * @tparam Hop The number of samples between estimates. The default is a quarter of the window size.
+ */
+template <typename SignalIn, int WindowSize = 2048, int Hop = WindowSize/4>
+class PitchDetector : public Component<PitchDetector<SignalIn, WindowSize, Hop>>, public Parameters::ParameterListener
+{
+ static_assert(WindowSize >= 8 && (WindowSize & (WindowSize - 1)) == 0, "PitchDetector: WindowSize must be a power of 2");
+ static_assert(Hop >= 1 && Hop <= WindowSize, "PitchDetector: Hop must be between 1 and WindowSize");
+ 
+ static constexpr int FFTSize = 2*WindowSize;
+ static constexpr int MaximumLag = WindowSize/2;
+ 
+ Parameters &dspParam;
+ FFTPlan plan;
+ 
+ // Each channel keeps a double length history, so the latest window is always contiguous
+ std::vector<SampleType> history;
+ std::vector<SampleType> work;
+ std::vector<SampleType> nsdf;
+ std::array<int, SignalIn::Count> position;
+ std::array<int, SignalIn::Count> countdown;
+ std::array<SampleType, SignalIn::Count> frequency;
+ std::array<SampleType, SignalIn::Count> clarity;
+ 
+ SampleType minimumFrequency {60.};
+ SampleType maximumFrequency {1500.};
+ SampleType peakThreshold {0.9};
+ SampleType silencePower {1e-6};
+ int minLag {2};
+ int maxLag {MaximumLag};
+ 
+ void calculateLagRange()
+ {
+  maxLag = std::max(3, std::min(MaximumLag, static_cast<int>(std::ceil(dspParam.sampleRate()/minimumFrequency))));
+  minLag = std::max(2, std::min(maxLag - 1, static_cast<int>(std::floor(dspParam.sampleRate()/maximumFrequency))));
+ }
+ 
+ void analyse(int c)
+ {
+  const SampleType *x = history.data() + c*2*WindowSize + position[c];
+  
+  SampleType energy = 0.;
+  for (int j = 0; j < WindowSize; ++j) energy = std::fma(x[j], x[j], energy);
+  if (energy < silencePower*WindowSize)
+  {
+   clarity[c] = 0.;
+   return;
+  }
+  
+  // Autocorrelation by FFT, zero padded so that it does not wrap around
+  std::copy(x, x + WindowSize, work.begin());
+  std::fill(work.begin() + WindowSize, work.end(), 0.);
+  plan.forward(work.data(), false);
+  work[0] *= work[0];
+  work[FFTSize/2] *= work[FFTSize/2];
+  for (int k = 1; k < FFTSize/2; ++k)
+  {
+   work[k] = work[k]*work[k] + work[FFTSize - k]*work[FFTSize - k];
+   work[FFTSize - k] = 0.;
+  }
+  plan.inverse(work.data());
+  const SampleType rScale = energy/work[0];
+  
+  // The normalised square difference function, with the energy term updated incrementally
+  SampleType m = 2.*energy;
+  nsdf[0] = 1.;
+  for (int t = 1; t <= maxLag + 1; ++t)
+  {
+   m -= x[t - 1]*x[t - 1] + x[WindowSize - t]*x[WindowSize - t];
+   nsdf[t] = m > 0. ? 2.*rScale*work[t]/m : 0.;
+  }
+  
+  // Find the highest point of each positive lobe after the first negative going zero crossing
+  int t = 1;
+  while (t <= maxLag && nsdf[t] > 0.) ++t;
+  SampleType highest = 0.;
+  int chosen = 0;
+  for (int pass = 0; pass < 2; ++pass)
+  {
+   int u = t;
+   while (u <= maxLag)
+   {
+    while (u <= maxLag && nsdf[u] <= 0.) ++u;
+    int best = 0;
+    while (u <= maxLag && nsdf[u] > 0.)
+    {
+     if (u >= minLag && (best == 0 || nsdf[u] > nsdf[best])) best = u;
+     ++u;
+    }
+    if (best == 0) continue;
+    if (pass == 0) highest = std::max(highest, nsdf[best]);
+    else if (nsdf[best] >= peakThreshold*highest)
+    {
+     chosen = best;
+     break;
+    }
+   }
+  }
+  
+  if (chosen == 0)
+  {
+   clarity[c] = 0.;
+   return;
+  }
+  
+  // Parabolic interpolation around the chosen peak
+  const SampleType a = nsdf[chosen - 1];
+  const SampleType b = nsdf[chosen];
+  const SampleType d = nsdf[chosen + 1];
+  const SampleType denominator = a - 2.*b + d;
+  SampleType delta = 0.;
+  if (denominator < 0.) delta = 0.5*(a - d)/denominator;
+  delta = std::max(static_cast<SampleType>(-0.5), std::min(static_cast<SampleType>(0.5), delta));
+  const SampleType height = b - 0.25*(a - d)*delta;
+  frequency[c] = dspParam.sampleRate()/(chosen + delta);
+  clarity[c] = std::min(static_cast<SampleType>(1.), height);
+ }
+ 
+public:
+ static constexpr int Count = SignalIn::Count;
+ 
+ SignalIn signalIn;
+ 
+ /// The detected frequency in Hz of each channel.
+ Output<Count> frequencyOut;
+ 
+ /// The clarity of the detected pitch of each channel, between 0 for no pitch and 1 for a perfectly periodic signal.
+ Output<Count> clarityOut;
+ 
+ PitchDetector(Parameters &p, SignalIn _signalIn) :
+ Parameters::ParameterListener(p),
+ dspParam(p),
+ plan(FFTSize),
+ history(Count*2*WindowSize, 0.),
+ work(FFTSize, 0.),
+ nsdf(MaximumLag + 2, 0.),
+ signalIn(_signalIn),
+ frequencyOut(p),
+ clarityOut(p)
+ {
+  calculateLagRange();
+  reset();
+ }
+ 
+ virtual void updateSampleRate(double sr, double isr) override
+ {
+  calculateLagRange();
+ }
+ 
+ virtual void updateBufferSize(int bs) override
+ {}
+ 
+ /**
+  * @brief Set the range of frequencies to search.
+  * 
+  * The lowest frequency is limited by the window size to twice the sample rate divided by the window size. Narrowing the range reduces the chance of octave errors.
+  * 
+  * @param lowest The lowest frequency to detect in Hz. The default is 60Hz.
+  * @param highest The highest frequency to detect in Hz. The default is 1500Hz.
+  */
+ void setFrequencyRange(SampleType lowest, SampleType highest)
+ {
+  minimumFrequency = std::max(lowest, static_cast<SampleType>(1.));
+  maximumFrequency = std::max(highest, minimumFrequency);
+  calculateLagRange();
+ }
+ 
+ /**
+  * @brief Set how close a peak must come to the highest peak to be chosen as the period.
+  * 
+  * Lower values favour shorter periods and so higher octaves, higher values favour the strongest periodicity and so can drop an octave.
+  * 
+  * @param threshold The fraction of the highest peak, between 0 and 1. The default is 0.9.
+  */
+ void setPeakThreshold(SampleType threshold)
+ { peakThreshold = std::max(static_cast<SampleType>(0.), std::min(static_cast<SampleType>(1.), threshold)); }
+ 
+ /**
+  * @brief Set the level below which the signal is treated as silence and no pitch is reported.
+  * 
+  * @param dB The RMS level of the window in dB. The default is -60dB.
+  */
+ void setSilenceThreshold(SampleType dB)
+ {
+  const SampleType l = dB2Linear(dB);
+  silencePower = l*l;
+ }
+ 
+ void reset()
+ {
+  std::fill(history.begin(), history.end(), 0.);
+  for (int c = 0; c < Count; ++c)
+  {
+   position[c] = 0;
+   countdown[c] = Hop - (c*Hop)/Count;
+   frequency[c] = 0.;
+   clarity[c] = 0.;
+  }
+  frequencyOut.reset();
+  clarityOut.reset();
+ }
+ 
+ void stepProcess(int startPoint, int sampleCount)
+ {
+  for (int c = 0; c < Count; ++c)
+  {
+   SampleType *h = history.data() + c*2*WindowSize;
+   for (int i = startPoint, s = sampleCount; s--; ++i)
+   {
+    const SampleType x = signalIn(c, i);
+    h[position[c]] = h[position[c] + WindowSize] = x;
+    position[c] = (position[c] + 1) & (WindowSize - 1);
+    if (--countdown[c] == 0)
+    {
+     countdown[c] = Hop;
+     analyse(c);
+    }
+    frequencyOut.buffer(c, i) = frequency[c];
+    clarityOut.buffer(c, i) = clarity[c];
+   }
+  }
+ }
+};
+
+
+
+
+
+
+
+
+
+
+
 }
 
 
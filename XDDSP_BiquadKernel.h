@@ -34,6 +34,8 @@ namespace XDDSP
 
 
 class BiquadFilterKernel;
+template <int Lanes, typename StateType> class MultichannelBiquadKernel;
+template <int Stages, typename StateType> class BiquadCascadeKernel;
 class BiquadFilterPublicInterface;
 
 
@@ -67,6 +69,8 @@ public:
  
 private:
  friend class BiquadFilterKernel;
+ template <int Lanes, typename StateType> friend class MultichannelBiquadKernel;
+ template <int Stages, typename StateType> friend class BiquadCascadeKernel;
  
  Parameters &dspParam;
  
@@ -77,6 +81,7 @@ private:
  SampleType g {0.};
  bool invert {false};
  bool cascade {false};
+ bool fast {false};
  
  double b0 {1.};
  double b1 {0.};
@@ -98,8 +103,20 @@ private:
   
   if (m == AllPass)
   {
-   double sinw {sin(2 * M_PI * w)};
-   double cosw {cos(2 * M_PI * w)};
+   double sinw, cosw;
+   if (fast)
+   {
+    // Double angle identities from the tangent of half the angle
+    const double t = fastTan(M_PI * w);
+    const double norm2 = 1.0 / (1.0 + t * t);
+    sinw = 2.0 * t * norm2;
+    cosw = (1.0 - t * t) * norm2;
+   }
+   else
+   {
+    sinw = sin(2 * M_PI * w);
+    cosw = cos(2 * M_PI * w);
+   }
    double alpha {sinw / (2.0 * Q)};
    norm = 1.0 / (1.0 + alpha);
    a2 = b0 = (1.0 - alpha) * norm;
@@ -108,7 +125,7 @@ private:
   }
   else
   {
-   double K = tan(M_PI * w);
+   double K = fast ? fastTan(M_PI * w) : tan(M_PI * w);
    
    switch (m)
    {
@@ -219,7 +236,7 @@ private:
  void calculateGain(SampleType gain)
  {
   gn = gain;
-  g = powf(10.0, fabs(gain) / 20.0);
+  g = fast ? fastdB2Linear(fabs(gain)) : powf(10.0, fabs(gain) / 20.0);
   invert = gain < 0.0;
  }
  
@@ -417,6 +434,28 @@ public:
   setCoefficients();
  }
  
+ /**
+  * @brief Enable or disable fast approximations of the tangent and dB to gain functions used to calculate the coefficients.
+  * 
+  * The approximations have relative errors below 2e-7, and are intended for filters which are reconfigured very often, such as DynamicBiquad.
+  * 
+  * @param enabled Set as true to use the approximations, or false to use the standard library functions.
+  */
+ void setFastApproximation(bool enabled)
+ {
+  fast = enabled;
+  calculateGain(gn);
+  setCoefficients();
+ }
+ 
+ /**
+  * @brief Get the calculated coefficients of the filter.
+  * 
+  * @return std::array<double, 5> The coefficients b0, b1, b2, a1 and a2, in that order.
+  */
+ std::array<double, 5> getCoefficients() const
+ { return {b0, b1, b2, a1, a2}; }
+ 
  /**
   * @brief Set a custom filter.
   * 
@@ -596,6 +635,210 @@ public:
 
 
 
+/**
+ * @brief Round a channel count up to a whole number of vector registers, for use with the multichannel filter kernels.
+ * 
+ * @param channels The number of channels.
+ * @return constexpr int The number of lanes to use.
+ */
+constexpr int multichannelKernelLanes(int channels)
+{ return (channels + 3)/4*4; }
+
+
+
+
+
+
+
+
+
+
+/**
+ * @brief A biquad filter implementation which processes several channels in lockstep with shared coefficients.
+ *        This is not a component. StaticBiquad and DynamicBiquad use this kernel automatically when they have more than one channel.
+ * 
+ * The state of each channel is held in its own lane of an array, so each step of the recursion is performed on every channel at once and the compiler can keep all the lanes in one vector register. The results are the same as one BiquadFilterKernel per channel.
+ * 
+ * @tparam Lanes The number of channels processed together. Multiples of 4 make the best use of vector registers.
+ * @tparam StateType The type used to store the filter state. The default matches BiquadFilterKernel. Use double for better stability at low frequencies with a single precision SampleType.
+ */
+template <int Lanes, typename StateType = SampleType>
+class MultichannelBiquadKernel
+{
+ static_assert(Lanes > 0, "MultichannelBiquadKernel: Lanes must be positive");
+ 
+ alignas(32) std::array<StateType, Lanes> d1;
+ alignas(32) std::array<StateType, Lanes> d2;
+ alignas(32) std::array<StateType, Lanes> d3;
+ alignas(32) std::array<StateType, Lanes> d4;
+ 
+public:
+ MultichannelBiquadKernel()
+ {
+  reset();
+ }
+ 
+ /**
+  * @brief Reset the filter.
+  * 
+  */
+ void reset()
+ {
+  d1.fill(0.);
+  d2.fill(0.);
+  d3.fill(0.);
+  d4.fill(0.);
+ }
+ 
+ /**
+  * @brief Process one sample of input for every lane, using the supplied coefficients.
+  * 
+  * @param coeff The coefficients object to use.
+  * @param x An array of one input sample for each lane, which is overwritten with the output samples.
+  */
+ void process(const BiquadFilterCoefficients &coeff, SampleType *x)
+ {
+  // The coefficients stay in double precision, as in BiquadFilterKernel
+  const double b0 = coeff.b0;
+  const double b1 = coeff.b1;
+  const double b2 = coeff.b2;
+  const double a1 = -coeff.a1;
+  const double a2 = -coeff.a2;
+  
+  if (coeff.cascade)
+  {
+   for (int l = 0; l < Lanes; ++l)
+   {
+    const StateType xn = x[l];
+    const StateType s = std::fma(b0, xn, d1[l]);
+    d1[l] = std::fma(b1, xn, std::fma(a1, s, d2[l]));
+    d2[l] = std::fma(b2, xn, a2*s);
+    
+    const StateType t = std::fma(b0, s, d3[l]);
+    d3[l] = std::fma(b1, s, std::fma(a1, t, d4[l]));
+    d4[l] = std::fma(b2, s, a2*t);
+    x[l] = t;
+   }
+  }
+  else
+  {
+   for (int l = 0; l < Lanes; ++l)
+   {
+    const StateType xn = x[l];
+    const StateType t = std::fma(b0, xn, d1[l]);
+    d1[l] = std::fma(b1, xn, std::fma(a1, t, d2[l]));
+    d2[l] = std::fma(b2, xn, a2*t);
+    x[l] = t;
+   }
+  }
+ }
+};
+
+
+
+
+
+
+
+
+
+
+/**
+ * @brief A cascade of biquad filters, one for each set of coefficients, processed together in one pass over a block of samples.
+ *        This is not a component. For a pre-built component which uses this filter, see BiquadCascade.
+ * 
+ * The filter state is copied into local variables for the duration of each block, so the compiler can keep it in registers instead of writing each stage out to memory. Stages which have their cascade setting enabled run two sections, as BiquadFilterKernel does.
+ * 
+ * @tparam Stages The number of sets of coefficients.
+ * @tparam StateType The type used to store the filter state. The default matches BiquadFilterKernel. Use double for better stability at low frequencies with a single precision SampleType.
+ */
+template <int Stages, typename StateType = SampleType>
+class BiquadCascadeKernel
+{
+ static_assert(Stages > 0, "BiquadCascadeKernel: Stages must be positive");
+ 
+ static constexpr int MaxSections = 2*Stages;
+ 
+ std::array<StateType, MaxSections> d1;
+ std::array<StateType, MaxSections> d2;
+ 
+public:
+ BiquadCascadeKernel()
+ {
+  reset();
+ }
+ 
+ /**
+  * @brief Reset the filter.
+  * 
+  */
+ void reset()
+ {
+  d1.fill(0.);
+  d2.fill(0.);
+ }
+ 
+ /**
+  * @brief Filter a block of samples in place.
+  * 
+  * @param coeff The coefficients of each stage.
+  * @param data The samples to filter, which are overwritten with the output.
+  * @param count The number of samples.
+  */
+ void process(const std::array<BiquadFilterCoefficients, Stages> &coeff, SampleType *data, int count)
+ {
+  // Gather the coefficients and state of the active sections
+  std::array<double, MaxSections> b0, b1, b2, a1, a2;
+  std::array<int, MaxSections> index;
+  StateType s1[MaxSections];
+  StateType s2[MaxSections];
+  int n = 0;
+  for (int st = 0; st < Stages; ++st)
+  {
+   const BiquadFilterCoefficients &k = coeff[st];
+   for (int r = 0; r < (k.cascade ? 2 : 1); ++r, ++n)
+   {
+    b0[n] = k.b0;
+    b1[n] = k.b1;
+    b2[n] = k.b2;
+    a1[n] = -k.a1;
+    a2[n] = -k.a2;
+    index[n] = 2*st + r;
+    s1[n] = d1[index[n]];
+    s2[n] = d2[index[n]];
+   }
+  }
+  
+  for (int i = 0; i < count; ++i)
+  {
+   StateType x = data[i];
+   for (int j = 0; j < n; ++j)
+   {
+    const StateType t = std::fma(b0[j], x, s1[j]);
+    s1[j] = std::fma(b1[j], x, std::fma(a1[j], t, s2[j]));
+    s2[j] = std::fma(b2[j], x, a2[j]*t);
+    x = t;
+   }
+   data[i] = x;
+  }
+  
+  for (int j = 0; j < n; ++j)
+  {
+   d1[index[j]] = s1[j];
+   d2[index[j]] = s2[j];
+  }
+ }
+};
+
+
+
+
+
+
+
+
+
+
 /**
  * @brief A convenient class that can be used to expose the BiquadCoefficients filter response calculators without exposing the configurators.
  * 
@@ -10,6 +10,8 @@
 
 #include "XDDSP_Types.h"
 #include "XDDSP_Functions.h"
+#include "XDDSP_SampleStorage.h"
+#include <algorithm>
 
 
 
@@ -40,7 +42,7 @@ namespace XDDSP
  * The CircularBuffer class encapsulates code and memory for implementing a circular buffer. The maximum size is specified as a power of two index (ie. size = 2^bits and maxDelay = size - 1). The buffer is allocated a fixed size determined at compile time. To implement a delay line, the code calls 'tapIn' first with the current sample, then calls 'tapOut' for each required tap. 
  * 
  * @tparam BufferSizeBits The size of the required buffer as a logarithm of 2 (ie. 3 = 8, 4 = 16, 8 = 256, 16 = 65536 etc.)
- * @tparam T The type to use in the buffer (this can be any type).
+ * @tparam T The type to use in the buffer (this can be any type). To save memory in long delay lines, use one of the compact sample types HalfSample, Int16Sample or PackedInt24Sample.
  */
 template <int BufferSizeBits, typename T = SampleType>
 class CircularBuffer
@@ -126,6 +128,58 @@ public:
   if (delay > Size.mask()) delay = Size.mask();
   return buffer[(bc - delay) & Size.mask()];
  }
+ 
+ /**
+  * @brief Write a block of elements into the buffer, which is the same as calling tapIn for each element in turn.
+  *        The elements are copied in at most two contiguous runs, without any index arithmetic for each element.
+  * 
+  * @tparam U The type of the elements to write. If this is not T, each element is converted to T as it is copied in.
+  * @param input The elements to write, oldest first.
+  * @param count The number of elements to write.
+  */
+ template <typename U>
+ void write(const U *input, int count)
+ {
+  const uint32_t length = Size.size();
+  if (count <= 0) return;
+  
+  // Elements which would be overwritten within the same block are skipped
+  if (static_cast<uint32_t>(count) > length)
+  {
+   bc = (bc + count - length) & Size.mask();
+   input += count - length;
+   count = length;
+  }
+  
+  const uint32_t start = (bc + 1) & Size.mask();
+  const uint32_t first = std::min(static_cast<uint32_t>(count), length - start);
+  std::copy(input, input + first, buffer.data() + start);
+  std::copy(input + first, input + count, buffer.data());
+  bc = (bc + count) & Size.mask();
+ }
+ 
+ /**
+  * @brief Read a block of elements from the buffer, which is the same as calling tapOut for each element from the oldest to the newest.
+  *        The elements are copied out in at most two contiguous runs, without any index arithmetic for each element. After writing a block with write, reading the same number of elements with some delay gives the output of a delay line of that length for the whole block.
+  * 
+  * @tparam U The type of the elements to read. If this is not T, each element is converted from T as it is copied out.
+  * @param delay How many elements back to go to find the newest element to read. There is no bounds checking, but the delay is limited so that the oldest element read is always in the buffer.
+  * @param output Receives the elements, oldest first, so that the last element is the same as tapOut(delay).
+  * @param count The number of elements to read, which must not be more than the size of the buffer.
+  */
+ template <typename U>
+ void read(uint32_t delay, U *output, int count) const
+ {
+  const uint32_t length = Size.size();
+  dsp_assert(count >= 0 && static_cast<uint32_t>(count) <= length);
+  if (count <= 0) return;
+  if (delay + count > length) delay = length - count;
+  
+  const uint32_t start = (bc + length - delay - (count - 1)) & Size.mask();
+  const uint32_t first = std::min(static_cast<uint32_t>(count), length - start);
+  std::copy(buffer.data() + start, buffer.data() + start + first, output);
+  std::copy(buffer.data(), buffer.data() + (count - first), output + first);
+ }
 };
 
 
@@ -144,7 +198,7 @@ public:
   * 
   * The size of the buffer can be adjusted at any time but the resulting size will always be a power of two big enough to accomodate. To implement a delay line, the code calls 'tapIn' first with the current sample, then calls 'tapOut' for each required tap. 
   *
-  * @tparam T The element type to use in the buffer.
+  * @tparam T The element type to use in the buffer. To save memory in long delay lines, use one of the compact sample types HalfSample, Int16Sample or PackedInt24Sample.
   */
 template <typename T = SampleType>
 class DynamicCircularBuffer
@@ -230,6 +284,58 @@ public:
   if (delay > size.mask()) delay = size.mask();
   return buffer[(bc - delay) & size.mask()];
  }
+ 
+ /**
+  * @brief Write a block of elements into the buffer, which is the same as calling tapIn for each element in turn.
+  *        The elements are copied in at most two contiguous runs, without any index arithmetic for each element.
+  * 
+  * @tparam U The type of the elements to write. If this is not T, each element is converted to T as it is copied in.
+  * @param input The elements to write, oldest first.
+  * @param count The number of elements to write.
+  */
+ template <typename U>
+ void write(const U *input, int count)
+ {
+  const uint32_t length = size.size();
+  if (count <= 0) return;
+  
+  // Elements which would be overwritten within the same block are skipped
+  if (static_cast<uint32_t>(count) > length)
+  {
+   bc = (bc + count - length) & size.mask();
+   input += count - length;
+   count = length;
+  }
+  
+  const uint32_t start = (bc + 1) & size.mask();
+  const uint32_t first = std::min(static_cast<uint32_t>(count), length - start);
+  std::copy(input, input + first, buffer.data() + start);
+  std::copy(input + first, input + count, buffer.data());
+  bc = (bc + count) & size.mask();
+ }
+ 
+ /**
+  * @brief Read a block of elements from the buffer, which is the same as calling tapOut for each element from the oldest to the newest.
+  *        The elements are copied out in at most two contiguous runs, without any index arithmetic for each element. After writing a block with write, reading the same number of elements with some delay gives the output of a delay line of that length for the whole block.
+  * 
+  * @tparam U The type of the elements to read. If this is not T, each element is converted from T as it is copied out.
+  * @param delay How many elements back to go to find the newest element to read. There is no bounds checking, but the delay is limited so that the oldest element read is always in the buffer.
+  * @param output Receives the elements, oldest first, so that the last element is the same as tapOut(delay).
+  * @param count The number of elements to read, which must not be more than the size of the buffer.
+  */
+ template <typename U>
+ void read(uint32_t delay, U *output, int count) const
+ {
+  const uint32_t length = size.size();
+  dsp_assert(count >= 0 && static_cast<uint32_t>(count) <= length);
+  if (count <= 0) return;
+  if (delay + count > length) delay = length - count;
+  
+  const uint32_t start = (bc + length - delay - (count - 1)) & size.mask();
+  const uint32_t first = std::min(static_cast<uint32_t>(count), length - start);
+  std::copy(buffer.data() + start, buffer.data() + start + first, output);
+  std::copy(buffer.data(), buffer.data() + (count - first), output + first);
+ }
 };
 
 
@@ -248,7 +354,7 @@ public:
   * 
   * The size of the buffer can be adjusted at any time. The buffer can be made any size, however it is slower as it uses modulus operations instead of bitmasks. To implement a delay line, the code calls 'tapIn' first with the current sample, then calls 'tapOut' for each required tap. 
   * 
-  * @tparam T 
+  * @tparam T The element type to use in the buffer. To save memory in long delay lines, use one of the compact sample types HalfSample, Int16Sample or PackedInt24Sample.
   */
 template <typename T = SampleType>
 class ModulusCircularBuffer
@@ -352,6 +458,58 @@ public:
   bc = (bc + 1) % size;
   return buffer[bc];
  }
+ 
+ /**
+  * @brief Write a block of elements into the buffer, which is the same as calling tapIn for each element in turn.
+  *        The elements are copied in at most two contiguous runs, without any index arithmetic for each element.
+  * 
+  * @tparam U The type of the elements to write. If this is not T, each element is converted to T as it is copied in.
+  * @param input The elements to write, oldest first.
+  * @param count The number of elements to write.
+  */
+ template <typename U>
+ void write(const U *input, int count)
+ {
+  const uint32_t length = size;
+  if (count <= 0) return;
+  
+  // Elements which would be overwritten within the same block are skipped
+  if (static_cast<uint32_t>(count) > length)
+  {
+   bc = (bc + count - length) % length;
+   input += count - length;
+   count = length;
+  }
+  
+  const uint32_t start = (bc + 1) % length;
+  const uint32_t first = std::min(static_cast<uint32_t>(count), length - start);
+  std::copy(input, input + first, buffer.data() + start);
+  std::copy(input + first, input + count, buffer.data());
+  bc = (bc + count) % length;
+ }
+ 
+ /**
+  * @brief Read a block of elements from the buffer, which is the same as calling tapOut for each element from the oldest to the newest.
+  *        The elements are copied out in at most two contiguous runs, without any index arithmetic for each element. After writing a block with write, reading the same number of elements with some delay gives the output of a delay line of that length for the whole block.
+  * 
+  * @tparam U The type of the elements to read. If this is not T, each element is converted from T as it is copied out.
+  * @param delay How many elements back to go to find the newest element to read. There is no bounds checking, but the delay is limited so that the oldest element read is always in the buffer.
+  * @param output Receives the elements, oldest first, so that the last element is the same as tapOut(delay).
+  * @param count The number of elements to read, which must not be more than the size of the buffer.
+  */
+ template <typename U>
+ void read(uint32_t delay, U *output, int count) const
+ {
+  const uint32_t length = size;
+  dsp_assert(count >= 0 && static_cast<uint32_t>(count) <= length);
+  if (count <= 0) return;
+  if (delay + count > length) delay = length - count;
+  
+  const uint32_t start = (bc + length - delay - (count - 1)) % length;
+  const uint32_t first = std::min(static_cast<uint32_t>(count), length - start);
+  std::copy(buffer.data() + start, buffer.data() + start + first, output);
+  std::copy(buffer.data(), buffer.data() + (count - first), output + first);
+ }
 };
 
 
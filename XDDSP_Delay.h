@@ -8,7 +8,11 @@
 #ifndef XDDSP_Delay_h
 #define XDDSP_Delay_h
 
+#include "XDDSP_Inputs.h"
 #include "XDDSP_CircularBuffer.h"
+#include "XDDSP_FIRImpulses.h"
+#include "XDDSP_WindowFunctions.h"
+#include <type_traits>
 
 
 
@@ -33,6 +37,8 @@ namespace XDDSP
 /**
  * @brief A simple delay component with no iterpolation.
  * 
+ * The delay time is checked in blocks of samples. When it holds still for a whole block, such as when it comes from a ControlConstant, each channel is delayed with one block copy into the buffer and one block copy out, instead of one sample at a time. This makes long static delays cheap, such as those used for latency alignment.
+ * 
  * @tparam SignalIn Couples to a signal to be delayed. The signal can have as many channels as you like.
  * @tparam DelayTimeIn Couples to the delay time input. Only one channel is allowed. The delay time is measured in samples and bounds checking is performed.
  * @tparam BufferType Either CircularBuffer, DynamicCircularBuffer or ModulusCircularBuffer, depending on your requirements.
@@ -47,6 +53,8 @@ public Component<LowQualityDelay<SignalIn, DelayTimeIn, BufferType>>
 {
  static_assert(DelayTimeIn::Count == 1, "DelayTimeIn is expected to have just one channel");
  
+ static constexpr int BlockSize = 64;
+ 
  // Private data members here
  std::array<BufferType, SignalIn::Count> buffer;
  
@@ -88,14 +96,44 @@ public:
  
  void stepProcess(int startPoint, int sampleCount)
  {
-  for (int i = startPoint, s = sampleCount; s--; ++i)
+  alignas(32) std::array<uint32_t, BlockSize> delayTime;
+  alignas(32) std::array<SampleType, BlockSize> x;
+  const uint32_t size = buffer[0].getSize();
+  
+  for (int i = startPoint, s = sampleCount; s > 0;)
   {
-   uint32_t delayTime = fastBoundary(delayTimeIn(0, i), 1., buffer[0].getSize());
-   for (int c = 0; c < Count; ++c)
+   const int n = std::min(s, BlockSize);
+   bool constantDelay = true;
+   for (int j = 0; j < n; ++j)
+   {
+    delayTime[j] = fastBoundary(delayTimeIn(0, i + j), 1., size);
+    constantDelay &= delayTime[j] == delayTime[0];
+   }
+   
+   if (constantDelay && delayTime[0] + n <= size)
    {
-    buffer[c].tapIn(signalIn(c, i));
-    signalOut.buffer(c, i) = buffer[c].tapOut(delayTime);
+    // The whole block is still in the buffer after writing it, so it can be read straight back out
+    for (int c = 0; c < Count; ++c)
+    {
+     for (int j = 0; j < n; ++j) x[j] = signalIn(c, i + j);
+     buffer[c].write(x.data(), n);
+     buffer[c].read(delayTime[0], signalOut.buffer[c] + i, n);
+    }
    }
+   else
+   {
+    for (int j = 0; j < n; ++j)
+    {
+     for (int c = 0; c < Count; ++c)
+     {
+      buffer[c].tapIn(signalIn(c, i + j));
+      signalOut.buffer(c, i + j) = buffer[c].tapOut(delayTime[j]);
+     }
+    }
+   }
+   
+   i += n;
+   s -= n;
   }
  }
 };
@@ -110,10 +148,12 @@ public:
 
 
 /**
- * @brief A simple delay with multiple taps
+ * @brief A simple delay component with linear interpolation.
+ * 
+ * The delay time is checked in blocks of samples. When it holds still for a whole block, each channel is written into the buffer as a block and the history behind it is read back out in one contiguous window, so the interpolation runs over plain arrays with a single fraction for the whole block.
  * 
  * @tparam SignalIn Couples to a signal to be delayed. The signal can have as many channels as you like.
- * @tparam DelayTimeIn Couples to the delay time input. An output is created for each channel in this coupler. The delay time is measured in samples and bounds checking is performed.
+ * @tparam DelayTimeIn Couples to the delay time input. Only one channel is allowed. The delay time is measured in samples and bounds checking is performed.
  * @tparam BufferType Either CircularBuffer, DynamicCircularBuffer or ModulusCircularBuffer, depending on your requirements.
  */
 template <
@@ -121,34 +161,38 @@ typename SignalIn,
 typename DelayTimeIn,
 typename BufferType = DynamicCircularBuffer<>
 >
-class MultiTapDelay :
-public Component<MultiTapDelay<SignalIn, DelayTimeIn, BufferType>>
+class MediumQualityDelay :
+public Component<MediumQualityDelay<SignalIn, DelayTimeIn, BufferType>>
 {
+ static_assert(DelayTimeIn::Count == 1, "MediumQualityDelay expects a delay time input with a single channel");
+ 
+ static constexpr int BlockSize = 64;
+ 
+ // Private data members here
  std::array<BufferType, SignalIn::Count> buffer;
  
 public:
- static constexpr int CountChannels = SignalIn::Count;
- static constexpr int CountTaps = DelayTimeIn::Count;
+ static constexpr int Count = SignalIn::Count;
  
  // The input signal to be delayed.
  SignalIn signalIn;
-
+ 
  // The delay time signal.
  DelayTimeIn delayTimeIn;
  
- // The delayed signal outputs.
- std::array<Output<CountChannels>, CountTaps> tapOut;
+ // The delayed signal output.
+ Output<Count> signalOut;
  
- MultiTapDelay(Parameters &p, SignalIn signalIn, DelayTimeIn delayTimeIn) :
+ MediumQualityDelay(Parameters &p, SignalIn signalIn, DelayTimeIn delayTimeIn) :
  signalIn(signalIn),
  delayTimeIn(delayTimeIn),
- tapOut(make_array<CountTaps>(Output<CountChannels>(p)))
+ signalOut(p)
  {}
  
  void reset()
  {
   for (auto& b : buffer) b.reset(0.);
-  for (auto& t : tapOut) t.reset();
+  signalOut.reset();
  }
  
  /**
@@ -165,17 +209,52 @@ public:
  
  void stepProcess(int startPoint, int sampleCount)
  {
-  for (int c = 0; c < CountChannels; ++c)
+  alignas(32) std::array<SampleType, BlockSize> fDelay;
+  alignas(32) std::array<SampleType, BlockSize> x;
+  alignas(32) std::array<SampleType, BlockSize + 1> window;
+  const uint32_t size = buffer[0].getSize();
+  
+  for (int i = startPoint, s = sampleCount; s > 0;)
   {
-   for (int i = startPoint, s = sampleCount; s--; ++i)
+   const int n = std::min(s, BlockSize);
+   bool constantDelay = true;
+   for (int j = 0; j < n; ++j)
    {
-    buffer[c].tapIn(signalIn(c, i));
-    for (int t = 0; t < CountTaps; ++t)
+    fDelay[j] = fastBoundary(delayTimeIn(0, i + j), 1., size);
+    constantDelay &= fDelay[j] == fDelay[0];
+   }
+   
+   IntegerAndFraction blockDelay(fDelay[0]);
+   if (constantDelay && static_cast<uint32_t>(blockDelay.intRep() + n + 1) <= size)
+   {
+    // window[j + 1] is tapOut(intRep) and window[j] is tapOut(intRep + 1) for sample j of the block
+    for (int c = 0; c < Count; ++c)
     {
-     uint32_t delayTime = fastBoundary(delayTimeIn(t, i), 1., buffer[c].getSize());
-     tapOut[t].buffer(c, i) = buffer[c].tapOut(delayTime);
+     SampleType *y = signalOut.buffer[c] + i;
+     for (int j = 0; j < n; ++j) x[j] = signalIn(c, i + j);
+     buffer[c].write(x.data(), n);
+     buffer[c].read(blockDelay.intRep(), window.data(), n + 1);
+     for (int j = 0; j < n; ++j) y[j] = LERP(blockDelay.fracPart(), window[j + 1], window[j]);
     }
    }
+   else
+   {
+    for (int j = 0; j < n; ++j)
+    {
+     IntegerAndFraction iaf(fDelay[j]);
+     
+     for (int c = 0; c < Count; ++c)
+     {
+      buffer[c].tapIn(signalIn(c, i + j));
+      SampleType x0 = buffer[c].tapOut(iaf.intRep());
+      SampleType x1 = buffer[c].tapOut(iaf.intRep() + 1);
+      signalOut.buffer(c, i + j) = LERP(iaf.fracPart(), x0, x1);
+     }
+    }
+   }
+   
+   i += n;
+   s -= n;
   }
  }
 };
@@ -190,7 +269,9 @@ public:
 
 
 /**
- * @brief A simple delay component with linear interpolation.
+ * @brief A simple delay component with hermite interpolation.
+ * 
+ * The delay time is checked in blocks of samples. When it holds still for a whole block, the four taps for every sample in the block are taken from one contiguous window of history read out of the buffer, instead of four separate taps for each sample.
  * 
  * @tparam SignalIn Couples to a signal to be delayed. The signal can have as many channels as you like.
  * @tparam DelayTimeIn Couples to the delay time input. Only one channel is allowed. The delay time is measured in samples and bounds checking is performed.
@@ -201,18 +282,19 @@ typename SignalIn,
 typename DelayTimeIn,
 typename BufferType = DynamicCircularBuffer<>
 >
-class MediumQualityDelay :
-public Component<MediumQualityDelay<SignalIn, DelayTimeIn, BufferType>>
+class HighQualityDelay :
+public Component<HighQualityDelay<SignalIn, DelayTimeIn, BufferType>>
 {
- static_assert(DelayTimeIn::Count == 1, "MediumQualityDelay expects a delay time input with a single channel");
+ static_assert(DelayTimeIn::Count == 1, "HighQualityDelay expects a delay time input with a single channel");
+ 
+ static constexpr int BlockSize = 64;
  
- // Private data members here
  std::array<BufferType, SignalIn::Count> buffer;
  
 public:
  static constexpr int Count = SignalIn::Count;
  
- // The input signal to be delayed.
+ // The input signal to be delayed
  SignalIn signalIn;
  
  // The delay time signal.
@@ -221,7 +303,7 @@ public:
  // The delayed signal output.
  Output<Count> signalOut;
  
- MediumQualityDelay(Parameters &p, SignalIn signalIn, DelayTimeIn delayTimeIn) :
+ HighQualityDelay(Parameters &p, SignalIn signalIn, DelayTimeIn delayTimeIn) :
  signalIn(signalIn),
  delayTimeIn(delayTimeIn),
  signalOut(p)
@@ -247,18 +329,57 @@ public:
  
  void stepProcess(int startPoint, int sampleCount)
  {
-  for (int i = startPoint, s = sampleCount; s--; ++i)
+  alignas(32) std::array<SampleType, BlockSize> fDelay;
+  alignas(32) std::array<SampleType, BlockSize> x;
+  alignas(32) std::array<SampleType, BlockSize + 3> window;
+  const uint32_t size = buffer[0].getSize();
+  
+  for (int i = startPoint, s = sampleCount; s > 0;)
   {
-   const SampleType fDelay = fastBoundary(delayTimeIn(0, i), 1., buffer[0].getSize());
-   IntegerAndFraction iaf(fDelay);
-
-   for (int c = 0; c < Count; ++c)
+   const int n = std::min(s, BlockSize);
+   bool constantDelay = true;
+   for (int j = 0; j < n; ++j)
    {
-    buffer[c].tapIn(signalIn(c, i));
-    SampleType x0 = buffer[c].tapOut(iaf.intRep());
-    SampleType x1 = buffer[c].tapOut(iaf.intRep() + 1);
-    signalOut.buffer(c, i) = LERP(iaf.fracPart(), x0, x1);
+    fDelay[j] = fastBoundary(delayTimeIn(0, i + j), 2., size);
+    constantDelay &= fDelay[j] == fDelay[0];
    }
+   
+   IntegerAndFraction blockDelay(fDelay[0]);
+   if (constantDelay && static_cast<uint32_t>(blockDelay.intRep() + n + 2) <= size)
+   {
+    // window[j + 3] is tapOut(intRep - 1) and window[j] is tapOut(intRep + 2) for sample j of the block
+    for (int c = 0; c < Count; ++c)
+    {
+     SampleType *y = signalOut.buffer[c] + i;
+     for (int j = 0; j < n; ++j) x[j] = signalIn(c, i + j);
+     buffer[c].write(x.data(), n);
+     buffer[c].read(blockDelay.intRep() - 1, window.data(), n + 3);
+     for (int j = 0; j < n; ++j)
+     {
+      y[j] = hermite(blockDelay.fracPart(), window[j + 3], window[j + 2], window[j + 1], window[j]);
+     }
+    }
+   }
+   else
+   {
+    for (int j = 0; j < n; ++j)
+    {
+     IntegerAndFraction iaf(fDelay[j]);
+     
+     for (int c = 0; c < Count; ++c)
+     {
+      buffer[c].tapIn(signalIn(c, i + j));
+      SampleType xm1 = buffer[c].tapOut(iaf.intRep() - 1);
+      SampleType x0 = buffer[c].tapOut(iaf.intRep());
+      SampleType x1 = buffer[c].tapOut(iaf.intRep() + 1);
+      SampleType x2 = buffer[c].tapOut(iaf.intRep() + 2);
+      signalOut.buffer(c, i + j) = hermite(iaf.fracPart(), xm1, x0, x1, x2);
+     }
+    }
+   }
+   
+   i += n;
+   s -= n;
   }
  }
 };
@@ -273,28 +394,321 @@ public:
 
 
 /**
- * @brief A simple delay component with hermite interpolation.
+ * @brief An interpolator for ModulatedDelay and MultiTapDelay which does no interpolation at all. The delay time is truncated to a whole number of samples, the same as LowQualityDelay.
+ * 
+ */
+class TruncatingInterpolator
+{
+public:
+ static constexpr int Taps = 1;
+ static constexpr int Offset = 0;
+ static constexpr int CoefficientCount = 1;
+ 
+ static void calculate(SampleType /*fraction*/, SampleType *coefficients)
+ { coefficients[0] = 1.; }
+ 
+ void reset()
+ {}
+ 
+ SampleType process(const SampleType * /*coefficients*/, const SampleType *taps)
+ { return taps[0]; }
+};
+
+
+
+
+
+
+
+
+
+
+/**
+ * @brief An interpolator for ModulatedDelay which fits a Lagrange polynomial through the taps surrounding the delay time.
+ * 
+ * An order of 1 gives linear interpolation. Orders 3 and 5 give progressively flatter frequency responses, at the cost of reading more taps for each sample.
+ * 
+ * @tparam Order The order of the polynomial, which must be odd so that the taps are centred on the delay time. The default is 3.
+ */
+template <int Order = 3>
+class LagrangeInterpolator
+{
+ static_assert(Order > 0 && Order % 2 == 1, "LagrangeInterpolator: Order must be odd");
+ 
+public:
+ static constexpr int Taps = Order + 1;
+ static constexpr int Offset = (Order - 1)/2;
+ static constexpr int CoefficientCount = Taps;
+ 
+private:
+ // The position of each tap relative to the integer part of the delay time, oldest first
+ static constexpr SampleType position(int t)
+ { return Taps - 1 - Offset - t; }
+ 
+ // The reciprocals of the denominators of the Lagrange basis polynomials, which are the same for every fraction
+ static constexpr std::array<SampleType, Taps> weights()
+ {
+  std::array<SampleType, Taps> w {};
+  for (int t = 0; t < Taps; ++t)
+  {
+   SampleType d = 1.;
+   for (int u = 0; u < Taps; ++u) if (u != t) d *= position(t) - position(u);
+   w[t] = 1./d;
+  }
+  return w;
+ }
+ 
+public:
+ /**
+  * @brief Calculate the coefficients for a fractional delay.
+  * 
+  * @param fraction The fractional part of the delay time, between 0 and 1.
+  * @param coefficients Receives CoefficientCount coefficients.
+  */
+ static void calculate(SampleType fraction, SampleType *coefficients)
+ {
+  static constexpr std::array<SampleType, Taps> w = weights();
+  for (int t = 0; t < Taps; ++t)
+  {
+   SampleType c = w[t];
+   for (int u = 0; u < Taps; ++u) if (u != t) c *= fraction - position(u);
+   coefficients[t] = c;
+  }
+ }
+ 
+ void reset()
+ {}
+ 
+ /**
+  * @brief Interpolate one sample.
+  * 
+  * @param coefficients The coefficients produced by calculate.
+  * @param taps Taps consecutive samples from the delay line, oldest first.
+  * @return SampleType The interpolated sample.
+  */
+ SampleType process(const SampleType *coefficients, const SampleType *taps)
+ {
+  SampleType y = 0.;
+  for (int t = 0; t < Taps; ++t) y += coefficients[t]*taps[t];
+  return y;
+ }
+};
+
+
+
+
+
+
+
+
+
+
+/**
+ * @brief An interpolator for ModulatedDelay which uses a first order Thiran all pass filter to produce the fractional part of the delay.
+ * 
+ * The all pass filter has a perfectly flat magnitude response, so unlike the polynomial interpolators it does not dull the high frequencies, which makes it the best choice for delays inside feedback loops such as physical models. It has state, so it is best suited to delay times which change slowly. Fast modulation, and the jump between tap pairs as the fraction passes the half way point, can produce small transients.
+ */
+class ThiranInterpolator
+{
+ SampleType y1 {0.};
+ 
+public:
+ static constexpr int Taps = 3;
+ static constexpr int Offset = 1;
+ static constexpr int CoefficientCount = 4;
+ 
+ /**
+  * @brief Calculate the coefficients for a fractional delay.
+  * 
+  * The pair of taps feeding the filter is chosen so that the delay of the filter itself is always between half a sample and one and a half samples, where it is most accurate.
+  * 
+  * @param fraction The fractional part of the delay time, between 0 and 1.
+  * @param coefficients Receives CoefficientCount coefficients.
+  */
+ static void calculate(SampleType fraction, SampleType *coefficients)
+ {
+  if (fraction >= 0.5)
+  {
+   const SampleType a = (1. - fraction)/(1. + fraction);
+   coefficients[0] = 1.;
+   coefficients[1] = a;
+   coefficients[2] = 0.;
+   coefficients[3] = a;
+  }
+  else
+  {
+   const SampleType a = -fraction/(2. + fraction);
+   coefficients[0] = 0.;
+   coefficients[1] = 1.;
+   coefficients[2] = a;
+   coefficients[3] = a;
+  }
+ }
+ 
+ void reset()
+ { y1 = 0.; }
+ 
+ /**
+  * @brief Interpolate one sample.
+  * 
+  * @param coefficients The coefficients produced by calculate.
+  * @param taps Taps consecutive samples from the delay line, oldest first.
+  * @return SampleType The interpolated sample.
+  */
+ SampleType process(const SampleType *coefficients, const SampleType *taps)
+ {
+  y1 = coefficients[0]*taps[0] + coefficients[1]*taps[1] + coefficients[2]*taps[2] - coefficients[3]*y1;
+  return y1;
+ }
+};
+
+
+
+
+
+
+
+
+
+
+/**
+ * @brief An interpolator for ModulatedDelay which uses a windowed sinc kernel.
+ * 
+ * The kernel is windowed with a Blackman-Harris window and tabulated at a number of fractional positions when it is first used. The table is shared by every delay using the same template parameters. Coefficients between the tabulated positions are linearly interpolated.
+ * 
+ * With the default of eight taps each side the response at any fraction is within 0.01dB up to 0.3 of the sample rate, 0.2dB down at 0.35 and 1.3dB down at 0.4, which is flatter than any of the Lagrange interpolators. Halving HalfTaps doubles the width of the band below the Nyquist frequency where the response falls away, so with four taps each side it is 0.55dB down at a quarter of the sample rate.
+ * 
+ * @tparam HalfTaps The number of taps on each side of the delay time. The default is 8.
+ * @tparam Phases The number of fractional positions tabulated. The default is 256.
+ */
+template <int HalfTaps = 8, int Phases = 256>
+class SincInterpolator
+{
+ static_assert(HalfTaps > 0, "SincInterpolator: HalfTaps must be positive");
+ static_assert(Phases > 0, "SincInterpolator: Phases must be positive");
+ 
+public:
+ static constexpr int Taps = 2*HalfTaps;
+ static constexpr int Offset = HalfTaps - 1;
+ static constexpr int CoefficientCount = Taps;
+ 
+private:
+ using Table = std::array<SampleType, (Phases + 1)*Taps>;
+ 
+ static const Table& table()
+ {
+  static const Table t = []()
+  {
+   Table k;
+   WindowFunction::BlackmanHarris w(Taps);
+   for (int p = 0; p <= Phases; ++p)
+   {
+    const SampleType fraction = static_cast<SampleType>(p)/Phases;
+    SampleType sum = 0.;
+    for (int t = 0; t < Taps; ++t)
+    {
+     const SampleType x = HalfTaps - t - fraction;
+     k[p*Taps + t] = FIRImpulses::sinc(x)*w(x + HalfTaps);
+     sum += k[p*Taps + t];
+    }
+    
+    // Each position is normalised for unity gain at DC
+    for (int t = 0; t < Taps; ++t) k[p*Taps + t] /= sum;
+   }
+   return k;
+  }();
+  return t;
+ }
+ 
+public:
+ /**
+  * @brief Calculate the coefficients for a fractional delay.
+  * 
+  * @param fraction The fractional part of the delay time, between 0 and 1.
+  * @param coefficients Receives CoefficientCount coefficients.
+  */
+ static void calculate(SampleType fraction, SampleType *coefficients)
+ {
+  const Table &k = table();
+  IntegerAndFraction phase(fraction*Phases);
+  const int p = std::min(phase.intRep(), Phases - 1);
+  const SampleType *k0 = k.data() + p*Taps;
+  const SampleType *k1 = k0 + Taps;
+  for (int t = 0; t < Taps; ++t) coefficients[t] = LERP(phase.fracPart(), k0[t], k1[t]);
+ }
+ 
+ void reset()
+ {}
+ 
+ /**
+  * @brief Interpolate one sample.
+  * 
+  * @param coefficients The coefficients produced by calculate.
+  * @param taps Taps consecutive samples from the delay line, oldest first.
+  * @return SampleType The interpolated sample.
+  */
+ SampleType process(const SampleType *coefficients, const SampleType *taps)
+ {
+  SampleType y = 0.;
+  for (int t = 0; t < Taps; ++t) y += coefficients[t]*taps[t];
+  return y;
+ }
+};
+
+
+
+
+
+
+
+
+
+
+/**
+ * @brief A delay component with a choice of interpolator, for delay times which are modulated.
+ * 
+ * The interpolator decides how the fractional part of the delay time is produced, so quality can be traded for CPU on each instance. The interpolators provided are TruncatingInterpolator, LagrangeInterpolator, ThiranInterpolator and SincInterpolator.
+ * 
+ * An interpolator class provides:
+ * - Taps, the number of consecutive samples it reads for each output sample.
+ * - Offset, the number of those taps which are newer than the integer part of the delay time.
+ * - CoefficientCount and a static calculate function, which produces the coefficients for a fractional delay.
+ * - reset and process functions, which produce an output sample from the coefficients and the taps. The component holds one interpolator for each channel, so an interpolator can keep some state.
+ * 
+ * The samples are processed in blocks. The coefficients for each sample are calculated once and shared by every channel. Each channel is then written into its buffer as a block, and the history spanned by the delay times of the block is read back out in one contiguous window, so the taps come from a plain array rather than from separate reads of the buffer. Blocks where the delay time sweeps too far are processed one sample at a time instead.
  * 
  * @tparam SignalIn Couples to a signal to be delayed. The signal can have as many channels as you like.
  * @tparam DelayTimeIn Couples to the delay time input. Only one channel is allowed. The delay time is measured in samples and bounds checking is performed.
+ * @tparam Interpolator The interpolator class. The default is LagrangeInterpolator<3>.
  * @tparam BufferType Either CircularBuffer, DynamicCircularBuffer or ModulusCircularBuffer, depending on your requirements.
  */
 template <
 typename SignalIn,
 typename DelayTimeIn,
+typename Interpolator = LagrangeInterpolator<3>,
 typename BufferType = DynamicCircularBuffer<>
 >
-class HighQualityDelay :
-public Component<HighQualityDelay<SignalIn, DelayTimeIn, BufferType>>
+class ModulatedDelay :
+public Component<ModulatedDelay<SignalIn, DelayTimeIn, Interpolator, BufferType>>
 {
- static_assert(DelayTimeIn::Count == 1, "HighQualityDelay expects a delay time input with a single channel");
+ static_assert(DelayTimeIn::Count == 1, "ModulatedDelay: DelayTimeIn is expected to have just one channel");
+ 
+ static constexpr int BlockSize = 64;
+ static constexpr int Taps = Interpolator::Taps;
+ static constexpr int Offset = Interpolator::Offset;
+ static constexpr int CoefficientCount = Interpolator::CoefficientCount;
+ 
+ // The delay time can move by this many samples within one block before the block is processed one sample at a time
+ static constexpr int MaximumSpread = 64;
+ static constexpr int WindowSize = BlockSize + MaximumSpread + Taps;
  
  std::array<BufferType, SignalIn::Count> buffer;
+ std::array<Interpolator, SignalIn::Count> interpolator;
  
 public:
  static constexpr int Count = SignalIn::Count;
  
- // The input signal to be delayed
+ // The input signal to be delayed.
  SignalIn signalIn;
  
  // The delay time signal.
@@ -303,7 +717,7 @@ public:
  // The delayed signal output.
  Output<Count> signalOut;
  
- HighQualityDelay(Parameters &p, SignalIn signalIn, DelayTimeIn delayTimeIn) :
+ ModulatedDelay(Parameters &p, SignalIn signalIn, DelayTimeIn delayTimeIn) :
  signalIn(signalIn),
  delayTimeIn(delayTimeIn),
  signalOut(p)
@@ -312,37 +726,337 @@ public:
  void reset()
  {
   for (auto& b : buffer) b.reset(0.);
+  for (auto& t : interpolator) t.reset();
   signalOut.reset();
  }
  
  /**
   * @brief Set the maximum delay time on the underlying buffer objects.
   * 
+  * The buffers are made big enough to hold the extra taps read by the interpolator, so that the full delay time is available.
   * If the component was compiled using the CircularBuffer class, this call is ignored.
   * 
   * @param maxDelay The new maximum delay time.
   */
  void setMaximumDelayTime(uint32_t maxDelay)
  {
-  for (auto& b : buffer) b.setMaximumLength(maxDelay);
+  for (auto& b : buffer) b.setMaximumLength(maxDelay + Taps);
  }
  
  void stepProcess(int startPoint, int sampleCount)
  {
-  for (int i = startPoint, s = sampleCount; s--; ++i)
+  alignas(32) std::array<int, BlockSize> delay;
+  alignas(32) std::array<SampleType, BlockSize*CoefficientCount> coefficients;
+  alignas(32) std::array<SampleType, BlockSize> x;
+  alignas(32) std::array<SampleType, WindowSize> window;
+  const int size = buffer[0].getSize();
+  const SampleType minDelay = Offset + 1;
+  const SampleType maxDelay = size - Taps + Offset;
+  
+  for (int i = startPoint, s = sampleCount; s > 0;)
   {
-   const SampleType fDelay = fastBoundary(delayTimeIn(0, i), 2., buffer[0].getSize());
-   IntegerAndFraction iaf(fDelay);
+   const int n = std::min(s, BlockSize);
+   int shortest = size;
+   int longest = 0;
+   for (int j = 0; j < n; ++j)
+   {
+    IntegerAndFraction iaf(fastBoundary(delayTimeIn(0, i + j), minDelay, maxDelay));
+    delay[j] = iaf.intRep();
+    Interpolator::calculate(iaf.fracPart(), coefficients.data() + j*CoefficientCount);
+    shortest = std::min(shortest, delay[j]);
+    longest = std::max(longest, delay[j]);
+   }
+   
+   // The newest and oldest taps read by any sample in the block, as delays from the end of the block
+   const int newest = shortest - Offset;
+   const int oldest = longest - Offset + Taps - 1 + n - 1;
+   const int span = oldest - newest + 1;
+   
+   if (span <= WindowSize && oldest < size)
+   {
+    for (int c = 0; c < Count; ++c)
+    {
+     SampleType *y = signalOut.buffer[c] + i;
+     for (int j = 0; j < n; ++j) x[j] = signalIn(c, i + j);
+     buffer[c].write(x.data(), n);
+     buffer[c].read(newest, window.data(), span);
+     
+     for (int j = 0; j < n; ++j)
+     {
+      const SampleType *taps = window.data() + span - 1 - (delay[j] - Offset + Taps - 1 + n - 1 - j - newest);
+      y[j] = interpolator[c].process(coefficients.data() + j*CoefficientCount, taps);
+     }
+    }
+   }
+   else
+   {
+    alignas(32) std::array<SampleType, Taps> taps;
+    for (int j = 0; j < n; ++j)
+    {
+     for (int c = 0; c < Count; ++c)
+     {
+      buffer[c].tapIn(signalIn(c, i + j));
+      for (int t = 0; t < Taps; ++t) taps[t] = buffer[c].tapOut(delay[j] - Offset + Taps - 1 - t);
+      signalOut.buffer(c, i + j) = interpolator[c].process(coefficients.data() + j*CoefficientCount, taps.data());
+     }
+    }
+   }
+   
+   i += n;
+   s -= n;
+  }
+ }
+};
+
+
+
+
+
+
+
+
+
+
+
+/**
+ * @brief A delay with multiple taps, each with its own delay time, gain and output, and a mixed output of all of the taps.
+ * 
+ * The interpolator decides how fractional delay times are handled, in the same way as ModulatedDelay. The default, TruncatingInterpolator, truncates the delay times to whole samples.
+ * 
+ * The samples are processed in blocks. Each channel is written into its buffer as a block. Then for each tap, the coefficients for every sample are calculated once, and the history spanned by the delay times of the tap over the block is read out of each channel in one contiguous window, which the tap is interpolated from. A static tap without interpolation is therefore a block copy. Blocks where the delay time of any tap sweeps too far are processed one sample at a time instead.
+ * 
+ * Patterns of taps, such as early reflections, can be loaded as a tap table with loadTapTable when the delay times come from a ControlConstant.
+ * 
+ * @tparam SignalIn Couples to a signal to be delayed. The signal can have as many channels as you like.
+ * @tparam DelayTimeIn Couples to the delay time input. An output is created for each channel in this coupler. The delay time is measured in samples and bounds checking is performed.
+ * @tparam BufferType Either CircularBuffer, DynamicCircularBuffer or ModulusCircularBuffer, depending on your requirements.
+ * @tparam Interpolator The interpolator class. See ModulatedDelay for the interpolators available. The default is TruncatingInterpolator.
+ */
+template <
+typename SignalIn,
+typename DelayTimeIn,
+typename BufferType = DynamicCircularBuffer<>,
+typename Interpolator = TruncatingInterpolator
+>
+class MultiTapDelay :
+public Component<MultiTapDelay<SignalIn, DelayTimeIn, BufferType, Interpolator>>
+{
+public:
+ static constexpr int CountChannels = SignalIn::Count;
+ static constexpr int CountTaps = DelayTimeIn::Count;
+ 
+private:
+ static constexpr int BlockSize = 64;
+ static constexpr int InterpolatorTaps = Interpolator::Taps;
+ static constexpr int Offset = Interpolator::Offset;
+ static constexpr int CoefficientCount = Interpolator::CoefficientCount;
+ 
+ // The delay time of a tap can move by this many samples within one block before the block is processed one sample at a time
+ static constexpr int MaximumSpread = 64;
+ static constexpr int WindowSize = BlockSize + MaximumSpread + InterpolatorTaps;
+ 
+ std::array<BufferType, CountChannels> buffer;
+ std::array<std::array<Interpolator, CountTaps>, CountChannels> interpolator;
+ std::array<SampleType, CountTaps> gain;
+ 
+public:
+ // The input signal to be delayed.
+ SignalIn signalIn;
 
-   for (int c = 0; c < Count; ++c)
+ // The delay time signal.
+ DelayTimeIn delayTimeIn;
+ 
+ // The delayed signal outputs.
+ std::array<Output<CountChannels>, CountTaps> tapOut;
+ 
+ // The sum of all of the delayed signal outputs.
+ Output<CountChannels> mixOut;
+ 
+ MultiTapDelay(Parameters &p, SignalIn signalIn, DelayTimeIn delayTimeIn) :
+ signalIn(signalIn),
+ delayTimeIn(delayTimeIn),
+ tapOut(make_array<CountTaps>(Output<CountChannels>(p))),
+ mixOut(p)
+ {
+  gain.fill(1.);
+ }
+ 
+ void reset()
+ {
+  for (auto& b : buffer) b.reset(0.);
+  for (auto& c : interpolator) for (auto& t : c) t.reset();
+  for (auto& t : tapOut) t.reset();
+  mixOut.reset();
+ }
+ 
+ /**
+  * @brief Set the maximum delay time on the underlying buffer objects.
+  * 
+  * The buffers are made big enough to hold the extra taps read by the interpolator, so that the full delay time is available.
+  * If the component was compiled using the CircularBuffer class, this call is ignored.
+  * 
+  * @param maxDelay The new maximum delay time.
+  */
+ void setMaximumDelayTime(uint32_t maxDelay)
+ {
+  for (auto& b : buffer) b.setMaximumLength(maxDelay + InterpolatorTaps);
+ }
+ 
+ /**
+  * @brief Set the gain of one tap, which scales both the output of the tap and its contribution to the mixed output.
+  * 
+  * @param tap The tap to set.
+  * @param g The gain. The default is 1.
+  */
+ void setTapGain(int tap, SampleType g)
+ {
+  gain.at(tap) = g;
+ }
+ 
+ /**
+  * @brief Get the gain of one tap.
+  * 
+  * @param tap The tap to look at.
+  * @return SampleType The gain of the tap.
+  */
+ SampleType getTapGain(int tap) const
+ {
+  return gain.at(tap);
+ }
+ 
+ /**
+  * @brief Load a tap table, which sets the delay time and gain of every tap at once.
+  *        This can only be used when the delay times come from a ControlConstant with one channel for each tap.
+  * 
+  * The gains of any taps past the end of the table are set to 0, so that they are silent in the mixed output.
+  * 
+  * @param delays The delay time of each tap in samples.
+  * @param gains The gain of each tap. If this is nullptr, the gains are all set to 1.
+  * @param count The number of taps in the table, which must not be more than CountTaps.
+  */
+ void loadTapTable(const SampleType *delays, const SampleType *gains, int count)
+ {
+  static_assert(std::is_same<DelayTimeIn, ControlConstant<CountTaps>>::value, "MultiTapDelay: Tap tables can only be loaded when DelayTimeIn is a ControlConstant");
+  dsp_assert(count >= 0 && count <= CountTaps);
+  
+  for (int t = 0; t < CountTaps; ++t)
+  {
+   if (t < count)
+   {
+    delayTimeIn.setControl(t, delays[t]);
+    gain[t] = (gains) ? gains[t] : 1.;
+   }
+   else gain[t] = 0.;
+  }
+ }
+ 
+ void stepProcess(int startPoint, int sampleCount)
+ {
+  alignas(32) std::array<std::array<SampleType, BlockSize>, CountTaps> fDelay;
+  alignas(32) std::array<int, BlockSize> delay;
+  alignas(32) std::array<SampleType, BlockSize*CoefficientCount> coefficients;
+  alignas(32) std::array<SampleType, BlockSize> x;
+  alignas(32) std::array<SampleType, WindowSize> window;
+  const int size = buffer[0].getSize();
+  const SampleType minDelay = Offset + 1;
+  const SampleType maxDelay = size - InterpolatorTaps + Offset;
+  
+  for (int i = startPoint, s = sampleCount; s > 0;)
+  {
+   const int n = std::min(s, BlockSize);
+   
+   // Check that every tap can be read from a window of history after the whole block is written
+   bool windowed = true;
+   for (int t = 0; t < CountTaps; ++t)
    {
-    buffer[c].tapIn(signalIn(c, i));
-    SampleType xm1 = buffer[c].tapOut(iaf.intRep() - 1);
-    SampleType x0 = buffer[c].tapOut(iaf.intRep());
-    SampleType x1 = buffer[c].tapOut(iaf.intRep() + 1);
-    SampleType x2 = buffer[c].tapOut(iaf.intRep() + 2);
-    signalOut.buffer(c, i) = hermite(iaf.fracPart(), xm1, x0, x1, x2);
+    SampleType shortest = maxDelay;
+    SampleType longest = minDelay;
+    for (int j = 0; j < n; ++j)
+    {
+     fDelay[t][j] = fastBoundary(delayTimeIn(t, i + j), minDelay, maxDelay);
+     shortest = std::min(shortest, fDelay[t][j]);
+     longest = std::max(longest, fDelay[t][j]);
+    }
+    const int newest = static_cast<int>(shortest) - Offset;
+    const int oldest = static_cast<int>(longest) - Offset + InterpolatorTaps - 1 + n - 1;
+    windowed = windowed && oldest - newest + 1 <= WindowSize && oldest < size;
    }
+   
+   for (int c = 0; c < CountChannels; ++c) std::fill(mixOut.buffer[c] + i, mixOut.buffer[c] + i + n, 0.);
+   
+   if (windowed)
+   {
+    for (int c = 0; c < CountChannels; ++c)
+    {
+     for (int j = 0; j < n; ++j) x[j] = signalIn(c, i + j);
+     buffer[c].write(x.data(), n);
+    }
+    
+    for (int t = 0; t < CountTaps; ++t)
+    {
+     int shortest = size;
+     int longest = 0;
+     for (int j = 0; j < n; ++j)
+     {
+      IntegerAndFraction iaf(fDelay[t][j]);
+      delay[j] = iaf.intRep();
+      Interpolator::calculate(iaf.fracPart(), coefficients.data() + j*CoefficientCount);
+      shortest = std::min(shortest, delay[j]);
+      longest = std::max(longest, delay[j]);
+     }
+     const int newest = shortest - Offset;
+     const int span = longest - shortest + InterpolatorTaps + n - 1;
+     
+     for (int c = 0; c < CountChannels; ++c)
+     {
+      SampleType *y = tapOut[t].buffer[c] + i;
+      SampleType *mix = mixOut.buffer[c] + i;
+      buffer[c].read(newest, window.data(), span);
+      
+      if (shortest == longest)
+      {
+       // The taps of a static tap start at the same place in the window as the sample, so the loop runs straight along the window
+       for (int j = 0; j < n; ++j)
+       {
+        y[j] = gain[t]*interpolator[c][t].process(coefficients.data() + j*CoefficientCount, window.data() + j);
+        mix[j] += y[j];
+       }
+      }
+      else
+      {
+       for (int j = 0; j < n; ++j)
+       {
+        const SampleType *taps = window.data() + span - 1 - (delay[j] - Offset + InterpolatorTaps - 1 + n - 1 - j - newest);
+        y[j] = gain[t]*interpolator[c][t].process(coefficients.data() + j*CoefficientCount, taps);
+        mix[j] += y[j];
+       }
+      }
+     }
+    }
+   }
+   else
+   {
+    alignas(32) std::array<SampleType, InterpolatorTaps> taps;
+    for (int c = 0; c < CountChannels; ++c)
+    {
+     for (int j = 0; j < n; ++j)
+     {
+      buffer[c].tapIn(signalIn(c, i + j));
+      for (int t = 0; t < CountTaps; ++t)
+      {
+       IntegerAndFraction iaf(fDelay[t][j]);
+       Interpolator::calculate(iaf.fracPart(), coefficients.data());
+       for (int k = 0; k < InterpolatorTaps; ++k) taps[k] = buffer[c].tapOut(iaf.intRep() - Offset + InterpolatorTaps - 1 - k);
+       const SampleType y = gain[t]*interpolator[c][t].process(coefficients.data(), taps.data());
+       tapOut[t].buffer(c, i + j) = y;
+       mixOut.buffer(c, i + j) += y;
+      }
+     }
+    }
+   }
+   
+   i += n;
+   s -= n;
   }
  }
 };
@@ -356,6 +1070,7 @@ public:
 
 
 
+
 }
 
 #endif /* XDDSP_Delay_h */
@@ -11,9 +11,21 @@
 #include <cmath>
 #include <array>
 #include <thread>
+#include <atomic>
+#include <fstream>
+#include <filesystem>
+#include <chrono>
+#include <map>
+#include <climits>
+#include <cerrno>
+#include <cstdlib>
+#include <limits>
+#include <numeric>
+#include <string>
 #include "XDDSP_Types.h"
 #include "XDDSP_Parameters.h"
 #include "XDDSP_Functions.h"
+#include "XDDSP_WindowFunctions.h"
 
 
 
@@ -415,6 +427,332 @@ void ifftDynamicSize(std::vector<T> &data)
 
 
 
+/**
+ * @brief A precomputed plan for computing FFTs of one size.
+ * 
+ * XDDSP::fftDynamicSize and XDDSP::ifftDynamicSize calculate their twiddle factors and data shuffle every time they are called. This class calculates them once when the size is set, so that repeated transforms of the same size do not compute any sines or cosines. The results are the same as XDDSP::fftDynamicSize and XDDSP::ifftDynamicSize, in the same format, apart from rounding.
+ */
+class FFTPlan
+{
+ unsigned long n {0};
+ std::vector<std::pair<unsigned long, unsigned long>> swaps;
+ std::vector<SampleType> twiddles;
+ std::vector<unsigned long> stageStart;
+ 
+ void shuffle(SampleType *data) const
+ {
+  for (auto &sw : swaps) std::swap(data[sw.first], data[sw.second]);
+ }
+ 
+public:
+ FFTPlan()
+ {}
+ 
+ /**
+  * @brief Construct a new FFTPlan object for one size.
+  * 
+  * @param size The size of the FFT. Must be a power of 2.
+  */
+ FFTPlan(unsigned long size)
+ { setSize(size); }
+ 
+ /**
+  * @brief Set the size of the FFT and calculate the plan. This allocates memory.
+  * 
+  * @param size The size of the FFT. Must be a power of 2.
+  */
+ void setSize(unsigned long size)
+ {
+  n = size;
+  
+  swaps.clear();
+  for (unsigned long i = 0, j = 0, n2 = n/2; i < n - 1; ++i)
+  {
+   if (i < j) swaps.emplace_back(i, j);
+   unsigned long k = n2;
+   while (k <= j)
+   {
+    j -= k;
+    k >>= 1;
+   }
+   j += k;
+  }
+  
+  // Four factors for every butterfly angle in every stage, with stages in order of increasing length
+  twiddles.clear();
+  stageStart.clear();
+  for (unsigned long n2 = 4; n2 <= n; n2 <<= 1)
+  {
+   stageStart.push_back(twiddles.size());
+   const double e = 2.*M_PI/n2;
+   for (unsigned long j = 2; j <= n2/8; ++j)
+   {
+    const double a = (j - 1)*e;
+    twiddles.push_back(std::cos(a));
+    twiddles.push_back(std::sin(a));
+    twiddles.push_back(std::cos(3.*a));
+    twiddles.push_back(std::sin(3.*a));
+   }
+  }
+ }
+ 
+ /**
+  * @brief Return the size of the FFT.
+  * 
+  * @return unsigned long The size of the FFT.
+  */
+ unsigned long size() const
+ { return n; }
+ 
+ /**
+  * @brief Compute an FFT in place. See XDDSP::fftDynamicSize.
+  * 
+  * @param data The data to transform, which must be the size of the plan. The data is overwritten by the transformed data.
+  * @param normalise If true, the transformed data is normalised at the end.
+  */
+ void forward(SampleType *data, bool normalise = true) const
+ {
+  unsigned long i, j, i5, i6, i7, i8, i0, iD, i1, i2, i3, i4, n2, n4, n8;
+  SampleType t1, t2, t3, t4, t5, t6, ss1, ss3, cc1, cc3;
+  
+  shuffle(data);
+  n4 = n - 1;
+  
+  //length two butterflies
+  i0 = 0;
+  iD = 4;
+  do
+  {
+   for (; i0 < n4; i0 += iD)
+   {
+    i1 = i0 + 1;
+    t1 = data[i0];
+    data[i0] = t1 + data[i1];
+    data[i1] = t1 - data[i1];
+   }
+   iD <<= 1;
+   i0 = iD - 2;
+   iD <<= 1;
+  } while (i0 < n4);
+  
+  //L shaped butterflies
+  n2 = 2;
+  for (unsigned long k = n, stage = 0; k > 2; k >>= 1, ++stage)
+  {
+   n2 <<= 1;
+   n4 = n2>>2;
+   n8 = n2>>3;
+   i1 = 0;
+   iD = n2<<1;
+   do
+   {
+    for (; i1 < n; i1 += iD)
+    {
+     i2 = i1 + n4;
+     i3 = i2 + n4;
+     i4 = i3 + n4;
+     t1 = data[i4] + data[i3];
+     data[i4] -= data[i3];
+     data[i3] = data[i1]-t1;
+     data[i1] += t1;
+     if (n4 != 1)
+     {
+      i0 = i1 + n8;
+      i2 += n8;
+      i3 += n8;
+      i4 += n8;
+      t1 = (data[i3] + data[i4])*FFTConstants::recSqrt2;
+      t2 = (data[i3] - data[i4])*FFTConstants::recSqrt2;
+      data[i4] = data[i2] - t1;
+      data[i3] =- data[i2] - t1;
+      data[i2] = data[i0] - t2;
+      data[i0] += t2;
+     }
+    }
+    iD <<= 1;
+    i1 = iD - n2;
+    iD <<= 1;
+   } while (i1 < n);
+   const SampleType *tw = twiddles.data() + stageStart[stage];
+   for (j = 2; j <= n8; j++, tw += 4)
+   {
+    cc1 = tw[0];
+    ss1 = tw[1];
+    cc3 = tw[2];
+    ss3 = tw[3];
+    i = 0;
+    iD = n2<<1;
+    do
+    {
+     for (; i < n; i += iD)
+     {
+      i1 = i + j - 1;
+      i2 = i1 + n4;
+      i3 = i2 + n4;
+      i4 = i3 + n4;
+      i5 = i + n4 - j + 1;
+      i6 = i5 + n4;
+      i7 = i6 + n4;
+      i8 = i7 + n4;
+      t1 = data[i3]*cc1 + data[i7]*ss1;
+      t2 = data[i7]*cc1 - data[i3]*ss1;
+      t3 = data[i4]*cc3 + data[i8]*ss3;
+      t4 = data[i8]*cc3 - data[i4]*ss3;
+      t5 = t1 + t3;
+      t6 = t2 + t4;
+      t3 = t1 - t3;
+      t4 = t2 - t4;
+      t2 = data[i6] + t6;
+      data[i3] = t6 - data[i6];
+      data[i8] = t2;
+      t2 = data[i2] - t3;
+      data[i7] =- data[i2] - t3;
+      data[i4] = t2;
+      t1 = data[i1] + t5;
+      data[i6] = data[i1] - t5;
+      data[i1] = t1;
+      t1 = data[i5] + t4;
+      data[i5] -= t4;
+      data[i2] = t1;
+     }
+     iD <<= 1;
+     i = iD - n2;
+     iD <<= 1;
+    } while(i < n);
+   }
+  }
+  
+  if (normalise)
+  {
+   SampleType nRec = 1./static_cast<SampleType>(n);
+   for (i = 0; i < n; ++i) data[i] *= nRec;
+  }
+ }
+ 
+ /**
+  * @brief Transform an FFT back into the time domain in place. See XDDSP::ifftDynamicSize.
+  * 
+  * @param data The data to transform, which must be the size of the plan. The data is overwritten by the transformed data.
+  */
+ void inverse(SampleType *data) const
+ {
+  long i, j, i5, i6, i7, i8, i0, iD, i1, i2, i3, i4, n2, n4, n8, n1;
+  SampleType t1, t2, t3, t4, t5, ss1, ss3, cc1, cc3;
+  const long sn = static_cast<long>(n);
+  
+  n1 = sn - 1;
+  n2 = sn<<1;
+  for (long k = sn, stage = static_cast<long>(stageStart.size()) - 1; k > 2; k >>= 1, --stage)
+  {
+   iD = n2;
+   n2 >>= 1;
+   n4 = n2 >> 2;
+   n8 = n2 >> 3;
+   i1 = 0;
+   do
+   {
+    for (; i1 < sn; i1 += iD)
+    {
+     i2 = i1 + n4;
+     i3 = i2 + n4;
+     i4 = i3 + n4;
+     t1 = data[i1] - data[i3];
+     data[i1] += data[i3];
+     data[i2] *= 2.;
+     data[i3] = t1 - 2.*data[i4];
+     data[i4] = t1 + 2.*data[i4];
+     if (n4 != 1)
+     {
+      i0 = i1 + n8;
+      i2 += n8;
+      i3 += n8;
+      i4 += n8;
+      t1 = (data[i2] - data[i0])*FFTConstants::recSqrt2;
+      t2 = (data[i4] + data[i3])*FFTConstants::recSqrt2;
+      data[i0] += data[i2];
+      data[i2] = data[i4] - data[i3];
+      data[i3] = 2.*(-t2 - t1);
+      data[i4] = 2.*(-t2 + t1);
+     }
+    }
+    iD <<= 1;
+    i1 = iD - n2;
+    iD <<= 1;
+   } while (i1 < n1);
+   const SampleType *tw = twiddles.data() + stageStart[stage];
+   for (j = 2; j <= n8; ++j, tw += 4)
+   {
+    cc1 = tw[0];
+    ss1 = tw[1];
+    cc3 = tw[2];
+    ss3 = tw[3];
+    i = 0;
+    iD = n2<<1;
+    do
+    {
+     for (; i < sn; i += iD)
+     {
+      i1 = i + j - 1;
+      i2 = i1 + n4;
+      i3 = i2 + n4;
+      i4 = i3 + n4;
+      i5 = i + n4 - j + 1;
+      i6 = i5 + n4;
+      i7 = i6 + n4;
+      i8 = i7 + n4;
+      t1 = data[i1] - data[i6];
+      data[i1] += data[i6];
+      t2 = data[i5] - data[i2];
+      data[i5] += data[i2];
+      t3 = data[i8] + data[i3];
+      data[i6] = data[i8] - data[i3];
+      t4 = data[i4] + data[i7];
+      data[i2] = data[i4] - data[i7];
+      t5 = t1 - t4;
+      t1 += t4;
+      t4 = t2 - t3;
+      t2 += t3;
+      data[i3] = t5*cc1 + t4*ss1;
+      data[i7] = -t4*cc1 + t5*ss1;
+      data[i4] = t1*cc3 - t2*ss3;
+      data[i8] = t2*cc3 + t1*ss3;
+     }
+     iD <<= 1;
+     i = iD - n2;
+     iD <<= 1;
+    } while(i < n1);
+   }
+  }
+  
+  i0 = 0;
+  iD = 4;
+  do
+  {
+   for (; i0 < n1; i0 += iD)
+   {
+    i1 = i0 + 1;
+    t1 = data[i0];
+    data[i0] = t1 + data[i1];
+    data[i1] = t1 - data[i1];
+   }
+   iD <<= 1;
+   i0 = iD - 2;
+   iD <<= 1;
+  } while (i0 < n1);
+  
+  shuffle(data);
+ }
+};
+
+
+
+
+
+
+
+
+
+
 /**
  * @brief Extract a complex sample from an FFT result.
  * 
@@ -522,6 +860,92 @@ void multiplyAndAddFFTs(T* output, T* in1, T* in2, unsigned long n)
 
 
 
+/**
+ * @brief Perform a complex multiplication of an FFT with an FFT stored in a compact 16 bit format.
+ * 
+ * The compact FFT is widened as it is read, so it never needs to be expanded in memory.
+ * 
+ * @tparam T The sample type, inferred from the input.
+ * @tparam Widen The type of the function which widens the compact format, inferred from the input.
+ * @param output A pointer to a suitable output buffer.
+ * @param in1 A pointer to one FFT input.
+ * @param in2 A pointer to the compact FFT input.
+ * @param scale A factor to multiply the widened compact FFT by.
+ * @param n The size of the output buffer, which must be the same as the two input buffers.
+ * @param widen A function which converts one compact value to a float, such as XDDSP::halfToFloat.
+ */
+template <typename T, typename Widen>
+void multiplyCompactFFTs(T* output, T* in1, const uint16_t* in2, T scale, unsigned long n, Widen widen)
+{
+ output[0] = in1[0] * (widen(in2[0])*scale);
+ output[n/2] = in1[n/2] * (widen(in2[n/2])*scale);
+ for (unsigned long p = 1; p < n/2; ++p)
+ {
+  const unsigned long p2 = n - p;
+  const T a = in1[p];
+  const T b = in1[p2];
+  const T c = widen(in2[p])*scale;
+  const T d = widen(in2[p2])*scale;
+  
+  // x = ac - bd
+  output[p] = std::fma(a, c, -b*d);
+  // y = ad + bc
+  output[p2] = std::fma(a, d, b*c);
+ }
+}
+
+
+
+
+
+
+
+
+
+
+/**
+ * @brief Multiply an FFT with an FFT stored in a compact 16 bit format and add the result to another FFT result.
+ * 
+ * @tparam T The sample type, inferred from the input.
+ * @tparam Widen The type of the function which widens the compact format, inferred from the input.
+ * @param output A pointer to the output buffer which contains the FFT to be added to.
+ * @param in1 A pointer to one FFT input.
+ * @param in2 A pointer to the compact FFT input.
+ * @param scale A factor to multiply the widened compact FFT by.
+ * @param n The size of the output buffer, which must be the same as the two input buffers.
+ * @param widen A function which converts one compact value to a float, such as XDDSP::halfToFloat.
+ */
+template <typename T, typename Widen>
+void multiplyAndAddCompactFFTs(T* output, T* in1, const uint16_t* in2, T scale, unsigned long n, Widen widen)
+{
+ output[0] += in1[0] * (widen(in2[0])*scale);
+ output[n/2] += in1[n/2] * (widen(in2[n/2])*scale);
+ for (unsigned long p = 1; p < n/2; ++p)
+ {
+  const unsigned long p2 = n - p;
+  const T a = in1[p];
+  const T b = in1[p2];
+  const T c = widen(in2[p])*scale;
+  const T d = widen(in2[p2])*scale;
+  
+  // x += ac - bd
+  output[p] = std::fma(a, c, output[p]);
+  output[p] = std::fma(-b, d, output[p]);
+  // y += ad + bc
+  output[p2] = std::fma(a, d, output[p2]);
+  output[p2] = std::fma(b, c, output[p2]);
+ }
+}
+
+
+
+
+
+
+
+
+
+
 /**
  * @brief Calculate the magnitude of one complex number in the FFT result.
  * 
@@ -816,6 +1240,67 @@ public:
 namespace ConvolutionEngine
 {
 
+/**
+ * @brief Contains the enum which selects how convolution kernels are stored.
+ * 
+ * Full stores kernels as SampleType. Half stores them as IEEE half precision floats and BFloat16 as bfloat16, both scaled per kernel, which halves the memory used by single precision kernels at the cost of some accuracy.
+ */
+struct KernelPrecision
+{
+ enum
+ {
+  Full = 0,
+  Half,
+  BFloat16
+ };
+};
+
+
+
+
+
+/**
+ * @brief A summary of the memory used by a set of kernels, and of the accuracy lost by storing them compactly.
+ * 
+ */
+struct KernelStorageReport
+{
+ /// The memory the kernels would use if they were stored at full precision, in bytes.
+ size_t fullBytes {0};
+ 
+ /// The memory the kernels actually use, in bytes.
+ size_t storedBytes {0};
+ 
+ /// The total energy of the kernels.
+ double signalEnergy {0.};
+ 
+ /// The total energy of the error introduced by compact storage.
+ double errorEnergy {0.};
+ 
+ /// The memory saved by compact storage, in bytes.
+ size_t savedBytes() const { return fullBytes - storedBytes; }
+ 
+ /// The signal to noise ratio of the stored kernels in decibels, or infinity if they are stored exactly.
+ double snrdB() const
+ {
+  if (errorEnergy <= 0.) return std::numeric_limits<double>::infinity();
+  return 10.*std::log10(signalEnergy/errorEnergy);
+ }
+ 
+ KernelStorageReport &operator+=(const KernelStorageReport &rhs)
+ {
+  fullBytes += rhs.fullBytes;
+  storedBytes += rhs.storedBytes;
+  signalEnergy += rhs.signalEnergy;
+  errorEnergy += rhs.errorEnergy;
+  return *this;
+ }
+};
+
+
+
+
+
 /**
  * @brief An internal container for storing convolution kernels.
  * 
@@ -823,23 +1308,173 @@ namespace ConvolutionEngine
 struct KernelContainer
 {
  std::vector<std::vector<SampleType>> k;
+ std::vector<std::vector<uint16_t>> compact;
+ std::vector<SampleType> scale;
+ std::vector<char> silentFlags;
+ std::vector<double> signalEnergy;
+ std::vector<double> errorEnergy;
+ int precision {KernelPrecision::Full};
+ unsigned int kernelSize {0};
  
  /// Set up the container
- void setup(unsigned int kernelCount, unsigned int kernelSize)
+ void setup(unsigned int kernelCount, unsigned int kernelSize, int precision = KernelPrecision::Full)
  {
+  this->precision = precision;
+  this->kernelSize = kernelSize;
   k.resize(kernelCount);
   for (auto &kk: k) kk.resize(kernelSize, 0.);
+  compact.assign(kernelCount, std::vector<uint16_t>());
+  scale.assign(kernelCount, 1.);
+  silentFlags.assign(kernelCount, false);
+  signalEnergy.assign(kernelCount, 0.);
+  errorEnergy.assign(kernelCount, 0.);
+ }
+ 
+ /// Mark a kernel as silent and release its storage. Silent kernels are skipped during convolution.
+ void release(unsigned int index)
+ {
+  dsp_assert(index < k.size());
+  silentFlags[index] = true;
+  std::vector<SampleType>().swap(k[index]);
+  std::vector<uint16_t>().swap(compact[index]);
+ }
+ 
+ /// Move a prepared kernel into compact storage, if the container uses it, measuring the error this introduces.
+ void compress(unsigned int index)
+ {
+  dsp_assert(index < k.size());
+  if (precision == KernelPrecision::Full) return;
+  
+  std::vector<SampleType> &full = k[index];
+  std::vector<uint16_t> &c = compact[index];
+  SampleType peak = 0.;
+  for (auto x : full) peak = std::max(peak, std::abs(x));
+  
+  // Scaling each kernel to a peak of one keeps its values well inside the range of a half precision float
+  scale[index] = peak > 0. ? peak : 1.;
+  const SampleType invScale = 1./scale[index];
+  c.resize(kernelSize);
+  double signal = 0.;
+  double error = 0.;
+  for (unsigned int i = 0; i < kernelSize; ++i)
+  {
+   const float x = static_cast<float>(full[i]*invScale);
+   c[i] = precision == KernelPrecision::Half ? floatToHalf(x) : floatToBFloat16(x);
+   const double e = full[i] - widen(c[i])*scale[index];
+   signal += static_cast<double>(full[i])*full[i];
+   error += e*e;
+  }
+  signalEnergy[index] = signal;
+  errorEnergy[index] = error;
+  std::vector<SampleType>().swap(full);
  }
  
+ /// Returns true if a kernel is silent.
+ bool silent(unsigned int index) const
+ {
+  dsp_assert(index < k.size());
+  return silentFlags[index];
+ }
+ 
+ /// Get the number of kernels which are not silent
+ unsigned int activeCount() const
+ { return static_cast<unsigned int>(std::count(silentFlags.begin(), silentFlags.end(), false)); }
+ 
  /// Get the size of the container
  unsigned int size() { return static_cast<unsigned int>(k.size()); }
  
- /// Return a pointer to convolution kernel data.
+ /// Return a pointer to convolution kernel data. Only valid for kernels which are not silent and not compressed.
  SampleType *get(unsigned int index)
  {
-  dsp_assert(index >= 0 && index < k.size());
+  dsp_assert(index < k.size());
   return k[index].data();
  }
+ 
+ /// Multiply an input spectrum by a kernel, writing the result into the output
+ void multiply(SampleType *output, SampleType *input, unsigned int index, unsigned int fftSize)
+ {
+  if (precision == KernelPrecision::Full) multiplyFFTs(output, input, get(index), fftSize);
+  else if (precision == KernelPrecision::Half) multiplyCompactFFTs(output, input, compact[index].data(), scale[index], fftSize, halfToFloat);
+  else multiplyCompactFFTs(output, input, compact[index].data(), scale[index], fftSize, bfloat16ToFloat);
+ }
+ 
+ /// Multiply an input spectrum by a kernel, adding the result to the output
+ void multiplyAndAdd(SampleType *output, SampleType *input, unsigned int index, unsigned int fftSize)
+ {
+  if (precision == KernelPrecision::Full) multiplyAndAddFFTs(output, input, get(index), fftSize);
+  else if (precision == KernelPrecision::Half) multiplyAndAddCompactFFTs(output, input, compact[index].data(), scale[index], fftSize, halfToFloat);
+  else multiplyAndAddCompactFFTs(output, input, compact[index].data(), scale[index], fftSize, bfloat16ToFloat);
+ }
+ 
+ /// Summarise the memory used by the container and the accuracy of its kernels
+ KernelStorageReport report() const
+ {
+  KernelStorageReport r;
+  const size_t active = activeCount();
+  r.fullBytes = active*kernelSize*sizeof(SampleType);
+  r.storedBytes = active*kernelSize*(precision == KernelPrecision::Full ? sizeof(SampleType) : sizeof(uint16_t));
+  if (precision != KernelPrecision::Full)
+  {
+   r.signalEnergy = std::accumulate(signalEnergy.begin(), signalEnergy.end(), 0.);
+   r.errorEnergy = std::accumulate(errorEnergy.begin(), errorEnergy.end(), 0.);
+  }
+  return r;
+ }
+ 
+ /// Write the kernels to a stream
+ void write(std::ostream &out) const
+ {
+  out.write(silentFlags.data(), silentFlags.size());
+  for (unsigned int i = 0; i < silentFlags.size(); ++i)
+  {
+   if (silentFlags[i]) continue;
+   if (precision == KernelPrecision::Full) writeData(out, k[i].data(), kernelSize);
+   else
+   {
+    writeData(out, &scale[i], 1);
+    writeData(out, &signalEnergy[i], 1);
+    writeData(out, &errorEnergy[i], 1);
+    writeData(out, compact[i].data(), kernelSize);
+   }
+  }
+ }
+ 
+ /// Read kernels written by write into a container which has been set up with the same layout
+ void read(std::istream &in)
+ {
+  std::vector<char> flags(silentFlags.size());
+  in.read(flags.data(), flags.size());
+  for (unsigned int i = 0; i < flags.size(); ++i)
+  {
+   if (flags[i])
+   {
+    release(i);
+    continue;
+   }
+   if (precision == KernelPrecision::Full) readData(in, k[i].data(), kernelSize);
+   else
+   {
+    std::vector<SampleType>().swap(k[i]);
+    compact[i].resize(kernelSize);
+    readData(in, &scale[i], 1);
+    readData(in, &signalEnergy[i], 1);
+    readData(in, &errorEnergy[i], 1);
+    readData(in, compact[i].data(), kernelSize);
+   }
+  }
+ }
+ 
+private:
+ SampleType widen(uint16_t x) const
+ { return precision == KernelPrecision::Half ? halfToFloat(x) : bfloat16ToFloat(x); }
+ 
+ template <typename T>
+ static void writeData(std::ostream &out, const T *data, size_t count)
+ { out.write(reinterpret_cast<const char*>(data), count*sizeof(T)); }
+ 
+ template <typename T>
+ static void readData(std::istream &in, T *data, size_t count)
+ { in.read(reinterpret_cast<char*>(data), count*sizeof(T)); }
 };
 
 
@@ -878,7 +1513,13 @@ public:
   dFS = 2*dBS;
  }
  
- int inputFFTSize() const { return iFS; }
+ // Shrink the deferred FFT size if the impulse response is too short to fill it
+ void fitImpulseLength(unsigned int size)
+ {
+  if (size < static_cast<unsigned int>(deferredFFTSize())) setParameters(inputSize(), size/2);
+ }
+ 
+ int inputFFTSize() const { return iFS; }
  int deferredFFTSize() const { return dFS; }
  int inputSize() const { return iBS; }
  int deferredSize() const { return dBS; }
@@ -889,6 +1530,125 @@ public:
 
 
 
+/**
+ * @brief Run a job once for every index in a range, sharing the indexes between a number of threads.
+ * 
+ * The calling thread does its share of the work and this function returns once every job is finished.
+ * 
+ * @param count The number of jobs to run.
+ * @param threadCount The number of threads to use, including the calling thread.
+ * @param job The job to run, which is called with the index of each job.
+ */
+inline void parallelFor(unsigned int count,
+                        unsigned int threadCount,
+                        const std::function<void (unsigned int)> &job)
+{
+ std::atomic<unsigned int> next {0};
+ auto worker = [&]()
+ {
+  for (unsigned int i = next++; i < count; i = next++) job(i);
+ };
+ 
+ threadCount = std::min(threadCount, count);
+ std::vector<std::thread> pool;
+ for (unsigned int t = 1; t < threadCount; ++t) pool.emplace_back(worker);
+ worker();
+ for (auto &t : pool) t.join();
+}
+
+
+
+
+
+/**
+ * @brief Settings for preparing the kernels of an impulse response.
+ * 
+ */
+struct KernelPreparation
+{
+ /// The number of threads which share the kernel FFTs, including the calling thread.
+ unsigned int threadCount {1};
+ 
+ /// Called with the number of kernels prepared so far and the total number of kernels. It may be called from any of the preparing threads, but never from two at once.
+ std::function<void (unsigned int, unsigned int)> onProgress;
+ 
+ /// How the kernels are stored, selected from KernelPrecision.
+ int precision {KernelPrecision::Full};
+};
+
+
+
+
+
+/**
+ * @brief Identifies a set of prepared kernels so that they can be found again in a kernel cache.
+ * 
+ */
+struct KernelCacheKey
+{
+ uint64_t impulseHash {0};
+ double sampleRate {0.};
+ uint32_t inputSize {0};
+ uint32_t deferredSize {0};
+ uint32_t sampleCount {0};
+ uint32_t sampleSize {sizeof(SampleType)};
+ uint32_t precision {KernelPrecision::Full};
+ 
+ KernelCacheKey() {}
+ 
+ KernelCacheKey(const ConvolutionParameters &cp,
+                const SampleType *impulseSamples,
+                unsigned int size,
+                double sampleRate,
+                int precision) :
+ impulseHash(hash(impulseSamples, size)),
+ sampleRate(sampleRate),
+ inputSize(cp.inputSize()),
+ deferredSize(cp.deferredSize()),
+ sampleCount(size),
+ precision(precision)
+ {}
+ 
+ // A 64 bit FNV-1a hash of the impulse samples
+ static uint64_t hash(const SampleType *impulseSamples, unsigned int size)
+ {
+  const unsigned char *bytes = reinterpret_cast<const unsigned char*>(impulseSamples);
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0, s = size*sizeof(SampleType); s--; ++i)
+  {
+   h ^= bytes[i];
+   h *= 1099511628211ULL;
+  }
+  return h;
+ }
+ 
+ // A file name which is unique to this key
+ std::string fileName() const
+ {
+  char name[96];
+  std::snprintf(name, sizeof(name), "%016llx_%u_%u_%u_%u_%u.xdkc",
+                static_cast<unsigned long long>(impulseHash),
+                static_cast<unsigned int>(sampleRate),
+                inputSize, deferredSize, sampleCount, precision);
+  return name;
+ }
+ 
+ bool operator==(const KernelCacheKey &rhs) const
+ {
+  return (impulseHash == rhs.impulseHash &&
+          sampleRate == rhs.sampleRate &&
+          inputSize == rhs.inputSize &&
+          deferredSize == rhs.deferredSize &&
+          sampleCount == rhs.sampleCount &&
+          sampleSize == rhs.sampleSize &&
+          precision == rhs.precision);
+ }
+};
+
+
+
+
+
 /**
  * @brief The data structure for storing impulse response data.
  * 
@@ -898,62 +1658,612 @@ struct ImpulseResponse
  KernelContainer inputKernels;
  KernelContainer deferredKernels;
  unsigned int sampleCount;
+ 
+ // The number of kernels used for the first part of the impulse response, which is convolved on the audio thread
+ static unsigned int inputKernelCount(const ConvolutionParameters &cp, unsigned int size)
+ {
+  unsigned int count = size/cp.inputSize() + 1;
+  if (cp.deferredProcessing() && static_cast<unsigned int>(cp.deferredSize()/cp.inputSize()) < count)
+  {
+   count = cp.deferredSize()/cp.inputSize();
+  }
+  return count;
+ }
+ 
+ // The number of kernels used for the rest of the impulse response, which is convolved by the deferred thread
+ static unsigned int deferredKernelCount(const ConvolutionParameters &cp, unsigned int size)
+ { return cp.deferredProcessing() ? size/cp.deferredSize() : 0; }
+ 
+ // The total number of kernels an impulse response of this size is split into
+ static unsigned int kernelCount(const ConvolutionParameters &cp, unsigned int size)
+ { return inputKernelCount(cp, size) + deferredKernelCount(cp, size); }
 
+ // The length of an impulse once the tail which holds less than the threshold of its total energy is removed. A threshold of 0 dB or more leaves the impulse untouched.
+ static unsigned int truncatedLength(const SampleType *impulseSamples,
+                                     unsigned int size,
+                                     double thresholddB)
+ {
+  if (thresholddB >= 0. || size == 0) return size;
+  double total = 0.;
+  for (unsigned int i = 0; i < size; ++i) total += static_cast<double>(impulseSamples[i])*impulseSamples[i];
+  const double limit = total*std::pow(10., thresholddB/10.);
+  
+  // Walk back from the end, integrating the energy of the tail until it is above the threshold
+  double tail = 0.;
+  unsigned int length = size;
+  while (length > 1)
+  {
+   const double x = impulseSamples[length - 1];
+   if (tail + x*x > limit) break;
+   tail += x*x;
+   --length;
+  }
+  return length;
+ }
+ 
  // Load an impulse response into the container, with consideration for the convolution parameters.
  void setImpulseResponse(ConvolutionParameters &cp,
                          const SampleType *impulseSamples,
-                         unsigned int size)
+                         unsigned int size,
+                         const KernelPreparation &prep = KernelPreparation())
  {
-  if (size < cp.deferredFFTSize()) cp.setParameters(cp.inputSize(), size/2);
+  cp.fitImpulseLength(size);
   sampleCount = size;
-  unsigned int inputKernCount = (size/cp.inputSize() + 1);
-  if (cp.deferredProcessing() && cp.deferredSize()/cp.inputSize() < inputKernCount)
-  {
-   inputKernCount = cp.deferredSize()/cp.inputSize();
-  }
-  computeKernels(inputKernels,
-                 inputKernCount,
-                 cp.inputFFTSize(),
-                 cp.inputSize(),
-                 size,
-                 0,
-                 impulseSamples);
-
-  if (cp.deferredProcessing())
-  {
-   const unsigned int deferredKernCount = size / cp.deferredSize();
-   computeKernels(deferredKernels,
-                  deferredKernCount,
-                  cp.deferredFFTSize(),
-                  cp.deferredSize(),
-                  size,
-                  1,
-                  impulseSamples);
-  }
+  const unsigned int inputKernCount = inputKernelCount(cp, size);
+  const unsigned int deferredKernCount = deferredKernelCount(cp, size);
+  inputKernels.setup(inputKernCount, cp.inputFFTSize(), prep.precision);
+  if (cp.deferredProcessing()) deferredKernels.setup(deferredKernCount, cp.deferredFFTSize(), prep.precision);
+  else deferredKernels.setup(0, 0);
+  
+  // Every kernel is independent, so the FFTs are shared between the threads
+  const unsigned int total = inputKernCount + deferredKernCount;
+  std::mutex progressMutex;
+  unsigned int done = 0;
+  parallelFor(total, prep.threadCount, [&](unsigned int i)
+  {
+   if (i < inputKernCount)
+   {
+    if (!computeKernel(inputKernels.get(i),
+                       cp.inputFFTSize(),
+                       cp.inputSize()*i,
+                       cp.inputSize(),
+                       impulseSamples)) inputKernels.release(i);
+    else inputKernels.compress(i);
+   }
+   else
+   {
+    const unsigned int d = i - inputKernCount;
+    if (!computeKernel(deferredKernels.get(d),
+                       cp.deferredFFTSize(),
+                       cp.deferredSize()*(d + 1),
+                       cp.deferredSize(),
+                       impulseSamples)) deferredKernels.release(d);
+    else deferredKernels.compress(d);
+   }
+   
+   if (prep.onProgress)
+   {
+    std::lock_guard<std::mutex> lock(progressMutex);
+    prep.onProgress(++done, total);
+   }
+  });
+ }
+ 
+ // The identifier and version at the start of every serialised set of kernels
+ static constexpr char SerialMagic[4] {'X', 'D', 'K', 'C'};
+ static constexpr uint32_t SerialVersion {3};
+ 
+ // Write the prepared kernels and their partition layout to a stream. Returns false if the stream failed.
+ bool writeKernels(std::ostream &out, const KernelCacheKey &key)
+ {
+  out.write(SerialMagic, sizeof(SerialMagic));
+  writeValue(out, SerialVersion);
+  writeKey(out, key);
+  writeValue(out, inputKernels.size());
+  writeValue(out, deferredKernels.size());
+  inputKernels.write(out);
+  deferredKernels.write(out);
+  return out.good();
+ }
+ 
+ // Read kernels written by writeKernels. Returns false, leaving the kernels unusable, if the stream does not hold kernels for this key and these convolution parameters.
+ bool readKernels(std::istream &in, const ConvolutionParameters &cp, const KernelCacheKey &key)
+ {
+  char magic[sizeof(SerialMagic)];
+  uint32_t version {0};
+  KernelCacheKey storedKey;
+  uint32_t counts[2] {0, 0};
+  in.read(magic, sizeof(magic));
+  readValue(in, version);
+  if (!in.good() ||
+      !std::equal(magic, magic + sizeof(magic), SerialMagic) ||
+      version != SerialVersion) return false;
+  
+  readKey(in, storedKey);
+  readValue(in, counts[0]);
+  readValue(in, counts[1]);
+  if (!in.good() ||
+      !(storedKey == key) ||
+      key.inputSize != static_cast<uint32_t>(cp.inputSize()) ||
+      key.deferredSize != static_cast<uint32_t>(cp.deferredSize()) ||
+      counts[0] != inputKernelCount(cp, key.sampleCount) ||
+      counts[1] != deferredKernelCount(cp, key.sampleCount)) return false;
+  
+  sampleCount = key.sampleCount;
+  inputKernels.setup(counts[0], cp.inputFFTSize(), key.precision);
+  if (cp.deferredProcessing()) deferredKernels.setup(counts[1], cp.deferredFFTSize(), key.precision);
   else deferredKernels.setup(0, 0);
+  inputKernels.read(in);
+  deferredKernels.read(in);
+  return in.good();
+ }
+ 
+ // Summarise the memory used by the kernels and the accuracy they are stored with
+ KernelStorageReport storageReport() const
+ {
+  KernelStorageReport r = inputKernels.report();
+  r += deferredKernels.report();
+  return r;
  }
  
 private:
- void computeKernels(KernelContainer &k,
-                     unsigned int count,
-                     unsigned int fftSize,
-                     unsigned int segmentSize,
-                     unsigned int totalSize,
-                     unsigned int startPoint,
-                     const SampleType *impulseSamples)
+ template <typename T>
+ static void writeValue(std::ostream &out, const T &value)
+ { out.write(reinterpret_cast<const char*>(&value), sizeof(T)); }
+ 
+ template <typename T>
+ static void readValue(std::istream &in, T &value)
+ { in.read(reinterpret_cast<char*>(&value), sizeof(T)); }
+ 
+ static void writeKey(std::ostream &out, const KernelCacheKey &key)
+ {
+  writeValue(out, key.impulseHash);
+  writeValue(out, key.sampleRate);
+  writeValue(out, key.inputSize);
+  writeValue(out, key.deferredSize);
+  writeValue(out, key.sampleCount);
+  writeValue(out, key.sampleSize);
+  writeValue(out, key.precision);
+ }
+ 
+ static void readKey(std::istream &in, KernelCacheKey &key)
+ {
+  readValue(in, key.impulseHash);
+  readValue(in, key.sampleRate);
+  readValue(in, key.inputSize);
+  readValue(in, key.deferredSize);
+  readValue(in, key.sampleCount);
+  readValue(in, key.sampleSize);
+  readValue(in, key.precision);
+ }
+ 
+ // Prepare one kernel. Returns false without transforming the kernel if its segment of the impulse is silent.
+ bool computeKernel(SampleType *kernel,
+                    unsigned int fftSize,
+                    unsigned int startPoint,
+                    unsigned int segmentSize,
+                    const SampleType *impulseSamples)
+ {
+  unsigned int start = std::min(startPoint, sampleCount);
+  unsigned int cs = std::min(startPoint + segmentSize, sampleCount);
+  if (std::all_of(impulseSamples + start, impulseSamples + cs, [](SampleType x) { return x == 0.; })) return false;
+  
+  std::fill(kernel, kernel + fftSize, 0.);
+  std::copy(impulseSamples + start, impulseSamples + cs, kernel);
+  fftDynamicSize(kernel, fftSize);
+  return true;
+ }
+};
+
+
+
+
+
+/**
+ * @brief An internal structure for keeping track of the impulse response samples given to a convolution component.
+ * 
+ */
+struct ImpulseSample
+{
+ bool set {false};
+ SampleType* pointerToSample {nullptr};
+ unsigned int length {0};
+ unsigned int usedLength {0};
+ 
+ // Work out how much of the sample to use, given a threshold for truncating the tail
+ void truncate(double thresholddB)
+ { usedLength = set ? ImpulseResponse::truncatedLength(pointerToSample, length, thresholddB) : 0; }
+};
+
+
+
+
+
+/**
+ * @brief Keeps prepared kernels in files in a directory so that an impulse response only needs to be prepared once.
+ * 
+ * The cache is disabled until a directory is set. Files which cannot be read or written are ignored and the kernels are prepared as normal.
+ */
+class KernelCache
+{
+ std::filesystem::path directory;
+ 
+public:
+ // Set the directory which holds the cache files. An empty path disables the cache.
+ void setDirectory(const std::filesystem::path &path)
+ { directory = path; }
+ 
+ // Returns true if a cache directory has been set
+ bool enabled() const
+ { return !directory.empty(); }
+ 
+ // Returns the cache directory
+ const std::filesystem::path &getDirectory() const
+ { return directory; }
+ 
+ // Fill an impulse response container, either from the cache or by preparing the kernels and then storing them in the cache.
+ void prepare(ImpulseResponse &imp,
+              ConvolutionParameters &cp,
+              const SampleType *impulseSamples,
+              unsigned int size,
+              double sampleRate,
+              const KernelPreparation &prep = KernelPreparation())
+ {
+  if (!enabled())
+  {
+   imp.setImpulseResponse(cp, impulseSamples, size, prep);
+   return;
+  }
+  
+  cp.fitImpulseLength(size);
+  const KernelCacheKey key(cp, impulseSamples, size, sampleRate, prep.precision);
+  const std::filesystem::path file = directory/key.fileName();
+  {
+   std::ifstream in(file, std::ios::binary);
+   if (in && imp.readKernels(in, cp, key))
+   {
+    const unsigned int total = ImpulseResponse::kernelCount(cp, size);
+    if (prep.onProgress) prep.onProgress(total, total);
+    return;
+   }
+  }
+  
+  imp.setImpulseResponse(cp, impulseSamples, size, prep);
+  
+  // Write to a temporary file first so that a partly written file is never read
+  std::error_code ec;
+  std::filesystem::create_directories(directory, ec);
+  std::filesystem::path temp = file;
+  temp += ".tmp";
+  bool written;
+  {
+   std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+   written = out && imp.writeKernels(out, key);
+  }
+  if (written) std::filesystem::rename(temp, file, ec);
+  else std::filesystem::remove(temp, ec);
+ }
+};
+
+
+
+
+
+/**
+ * @brief The FFT size chosen by FFTSizeTuner and the reasons it was chosen.
+ * 
+ */
+struct FFTTuning
+{
+ /// The CPU model the decision was made for.
+ std::string cpuModel;
+ 
+ /// The buffer size the decision was made for.
+ int bufferSize {0};
+ 
+ /// The length of the longest impulse response the decision was made for.
+ unsigned int impulseLength {0};
+ 
+ /// The chosen FFT size hint, or 0 if the FFT size was set manually.
+ unsigned int fftHint {0};
+ 
+ /// The estimated processing time as a fraction of real time, summed over the audio thread and the deferred thread.
+ double cpuLoad {0.};
+ 
+ /// The estimated processing time of the slowest buffer on the audio thread, as a fraction of the buffer period.
+ double peakLoad {0.};
+ 
+ /// True if the chosen layout is expected to finish all of its work in time.
+ bool meetsDeadline {false};
+ 
+ /// True if the decision was taken from the cache instead of being timed.
+ bool cached {false};
+};
+
+
+
+
+
+/**
+ * @brief Chooses the FFT size hint with the lowest processing cost on this machine.
+ * 
+ * Each candidate partition layout is costed by timing its FFTs and spectral multiplies on the machine, then the cheapest layout is chosen from those which leave enough time in each buffer period. Decisions are remembered for the life of the process for each CPU model, and can also be stored in a directory so that later sessions can skip the timing.
+ */
+class FFTSizeTuner
+{
+ // The fraction of a buffer period which the audio thread may spend on convolution
+ static constexpr double AudioThreadBudget {0.5};
+ 
+ // The fraction of a deferred block period which the deferred thread may spend on convolution
+ static constexpr double DeferredThreadBudget {0.5};
+ 
+ // The largest FFT hint considered
+ static constexpr unsigned int MaximumHint {16384};
+ 
+ // Measured times in seconds for one transform, and for one multiply, inverse transform and overlap add
+ struct Timing
+ {
+  double forward;
+  double accumulate;
+ };
+ 
+ static std::mutex &cacheMutex()
+ {
+  static std::mutex m;
+  return m;
+ }
+ 
+ static std::map<std::string, unsigned int> &memoryCache()
+ {
+  static std::map<std::string, unsigned int> c;
+  return c;
+ }
+ 
+ static Timing timeFFTSize(unsigned int fftSize)
+ {
+  using Clock = std::chrono::steady_clock;
+  std::vector<SampleType> a(fftSize), b(fftSize), proc(fftSize), olap(fftSize, 0.);
+  for (unsigned int i = 0; i < fftSize; ++i)
+  {
+   a[i] = b[i] = static_cast<SampleType>((i*7919 % 257)/257. - 0.5);
+  }
+  fftDynamicSize(b.data(), fftSize);
+  
+  // Repeat each measurement until it takes long enough to time reliably, then keep the fastest of a few runs
+  auto measure = [&](auto operation)
+  {
+   double best = 1e9;
+   for (int run = 0; run < 3; ++run)
+   {
+    unsigned int reps = 0;
+    const auto start = Clock::now();
+    auto now = start;
+    do
+    {
+     operation();
+     ++reps;
+     now = Clock::now();
+    } while (now - start < std::chrono::microseconds(500));
+    best = std::min(best, std::chrono::duration<double>(now - start).count()/reps);
+   }
+   return best;
+  };
+  
+  Timing t;
+  t.forward = measure([&]() { fftDynamicSize(a.data(), fftSize, false); });
+  t.accumulate = measure([&]()
+  {
+   multiplyFFTs(proc.data(), a.data(), b.data(), fftSize);
+   ifftDynamicSize(proc.data(), fftSize);
+   for (unsigned int j = 0; j < fftSize; ++j) olap[j] += proc[j];
+  });
+  return t;
+ }
+ 
+ static std::string cacheKey(const std::string &cpu,
+                             int bufferSize,
+                             unsigned int shortest,
+                             unsigned int longest,
+                             double sampleRate,
+                             unsigned int inputs,
+                             unsigned int paths,
+                             unsigned int outputs)
+ {
+  // Impulse lengths only matter to the nearest power of two
+  return (cpu + "|" + std::to_string(bufferSize) +
+          "|" + std::to_string(PowerSize::nextPowerTwoMinusOne(shortest)) +
+          "|" + std::to_string(PowerSize::nextPowerTwoMinusOne(longest)) +
+          "|" + std::to_string(static_cast<int>(sampleRate)) +
+          "|" + std::to_string(inputs) + "x" + std::to_string(paths) + "x" + std::to_string(outputs));
+ }
+ 
+ static bool isValidHint(unsigned long hint, int bufferSize)
+ {
+  return (hint > 0 &&
+          hint >= static_cast<unsigned long>(bufferSize) &&
+          hint <= MaximumHint &&
+          (hint & (hint - 1)) == 0);
+ }
+ 
+ static bool readFromFile(const std::filesystem::path &file,
+                          const std::string &key,
+                          int bufferSize,
+                          unsigned int &hint)
+ {
+  std::ifstream in(file);
+  std::string line;
+  while (std::getline(in, line))
+  {
+   const size_t tab = line.rfind('\t');
+   if (tab != std::string::npos && line.compare(0, tab, key) == 0 && tab == key.size())
+   {
+    // Skip any line which has been truncated or edited into something that is not a usable hint
+    const char *value = line.c_str() + tab + 1;
+    char *end = nullptr;
+    errno = 0;
+    const unsigned long v = std::strtoul(value, &end, 10);
+    if (end == value || *end != '\0' || errno == ERANGE) continue;
+    if (!isValidHint(v, bufferSize)) continue;
+    hint = static_cast<unsigned int>(v);
+    return true;
+   }
+  }
+  return false;
+ }
+ 
+ static void appendToFile(const std::filesystem::path &file,
+                          const std::string &key,
+                          unsigned int hint)
+ {
+  std::error_code ec;
+  std::filesystem::create_directories(file.parent_path(), ec);
+  std::ofstream out(file, std::ios::app);
+  out << key << '\t' << hint << '\n';
+ }
+ 
+public:
+ /**
+  * @brief Return a description of the CPU model of this machine.
+  * 
+  * On systems which do not provide a CPU model string, a generic description based on the number of hardware threads is returned.
+  */
+ static std::string cpuModel()
+ {
+  std::ifstream cpuinfo("/proc/cpuinfo");
+  std::string line;
+  while (std::getline(cpuinfo, line))
+  {
+   if (line.compare(0, 10, "model name") == 0)
+   {
+    const size_t colon = line.find(':');
+    if (colon != std::string::npos && colon + 2 <= line.size()) return line.substr(colon + 2);
+   }
+  }
+  return "unknown " + std::to_string(std::thread::hardware_concurrency()) + " thread CPU";
+ }
+ 
+ /**
+  * @brief Choose the FFT size hint for a convolution.
+  * 
+  * This times FFTs on the calling thread, so it takes a few tens of milliseconds when the decision is not cached, and must not be called from the audio thread.
+  * 
+  * @param bufferSize The buffer size of the audio thread.
+  * @param sampleRate The sample rate, which sets the time available for each buffer.
+  * @param shortest The length of the shortest impulse response, which limits the partition size.
+  * @param longest The length of the longest impulse response, which sets the number of partitions.
+  * @param inputs The number of input signals to transform.
+  * @param paths The number of impulse responses to convolve.
+  * @param outputs The number of output signals to inverse transform.
+  * @param cacheDirectory A directory to store decisions in so that later sessions can use them. May be empty.
+  * @return FFTTuning The decision.
+  */
+ static FFTTuning tune(int bufferSize,
+                       double sampleRate,
+                       unsigned int shortest,
+                       unsigned int longest,
+                       unsigned int inputs,
+                       unsigned int paths,
+                       unsigned int outputs,
+                       const std::filesystem::path &cacheDirectory = std::filesystem::path())
  {
-  k.setup(count, fftSize);
+  FFTTuning result;
+  result.cpuModel = cpuModel();
+  result.bufferSize = bufferSize;
+  result.impulseLength = longest;
+  
+  const std::string key = cacheKey(result.cpuModel, bufferSize, shortest, longest, sampleRate, inputs, paths, outputs);
+  const std::filesystem::path file = cacheDirectory.empty() ? cacheDirectory : cacheDirectory/"fft_tuning.txt";
+  
+  std::map<unsigned int, Timing> timings;
+  auto timing = [&](unsigned int fftSize) -> const Timing&
+  {
+   auto it = timings.find(fftSize);
+   if (it == timings.end()) it = timings.emplace(fftSize, timeFFTSize(fftSize)).first;
+   return it->second;
+  };
+  
+  // Estimate the cost of the layout for one hint. Returns false if the layout cannot keep up.
+  auto evaluate = [&](unsigned int hint, double &cpuLoad, double &peakLoad)
+  {
+   ConvolutionParameters cp;
+   cp.setParameters(bufferSize, hint);
+   cp.fitImpulseLength(shortest);
+   const double bufferPeriod = cp.inputSize()/sampleRate;
+   const double blockPeriod = cp.deferredSize()/sampleRate;
+   const Timing &in = timing(cp.inputFFTSize());
+   const double inputKernels = ImpulseResponse::inputKernelCount(cp, longest);
+   const double perBuffer = inputs*in.forward + paths*inputKernels*in.accumulate;
+   
+   double deferredOnAudio = 0.;
+   double deferredOnThread = 0.;
+   if (cp.deferredProcessing())
+   {
+    const Timing &def = timing(cp.deferredFFTSize());
+    const double deferredKernels = ImpulseResponse::deferredKernelCount(cp, longest);
+    deferredOnAudio = inputs*def.forward + paths*def.accumulate;
+    deferredOnThread = paths*std::max(0., deferredKernels - 1.)*def.accumulate;
+   }
+   
+   cpuLoad = perBuffer/bufferPeriod + (deferredOnAudio + deferredOnThread)/blockPeriod;
+   peakLoad = (perBuffer + deferredOnAudio)/bufferPeriod;
+   return (peakLoad <= AudioThreadBudget &&
+           deferredOnThread/blockPeriod <= DeferredThreadBudget);
+  };
+  
+  {
+   std::lock_guard<std::mutex> lock(cacheMutex());
+   auto it = memoryCache().find(key);
+   unsigned int hint;
+   bool found = it != memoryCache().end();
+   if (found) hint = it->second;
+   else if (!file.empty() && readFromFile(file, key, bufferSize, hint))
+   {
+    found = true;
+    memoryCache()[key] = hint;
+   }
+   
+   if (found)
+   {
+    result.fftHint = hint;
+    result.cached = true;
+    result.meetsDeadline = evaluate(hint, result.cpuLoad, result.peakLoad);
+    return result;
+   }
+  }
+  
+  // Try every distinct layout from the buffer size upwards
+  bool haveResult = false;
+  int lastSize = 0;
+  for (unsigned int hint = PowerSize::nextPowerTwoMinusOne(bufferSize) + 1; hint <= MaximumHint; hint *= 2)
+  {
+   ConvolutionParameters cp;
+   cp.setParameters(bufferSize, hint);
+   cp.fitImpulseLength(shortest);
+   if (cp.deferredSize() == lastSize) break;
+   lastSize = cp.deferredSize();
+   
+   double cpuLoad, peakLoad;
+   const bool meets = evaluate(hint, cpuLoad, peakLoad);
+   const bool better = (!haveResult ||
+                        (meets && !result.meetsDeadline) ||
+                        (meets == result.meetsDeadline &&
+                         (meets ? cpuLoad < result.cpuLoad : peakLoad < result.peakLoad)));
+   if (better)
+   {
+    haveResult = true;
+    result.fftHint = hint;
+    result.cpuLoad = cpuLoad;
+    result.peakLoad = peakLoad;
+    result.meetsDeadline = meets;
+   }
+  }
   
-  unsigned int c = startPoint*segmentSize;
-  for (int i = 0; i < count; ++i)
   {
-   k.k[i].assign(fftSize, 0.);
-   unsigned int start = std::min(c, totalSize - 1);
-   unsigned int cs = std::min(c + segmentSize, totalSize - 1);
-   if (start < cs) std::copy(impulseSamples + start, impulseSamples + cs, k.get(i));
-   fftDynamicSize(k.get(i), fftSize);
-   c += segmentSize;
+   std::lock_guard<std::mutex> lock(cacheMutex());
+   memoryCache()[key] = result.fftHint;
+   if (!file.empty()) appendToFile(file, key, result.fftHint);
   }
+  return result;
  }
 };
 
@@ -991,12 +2301,13 @@ class ConvolutionEngine
  PowerSize olapSize;
  
  void multiplyAndAccumulate(SampleType *input,
-                            SampleType *irKernel,
+                            KernelContainer &kernels,
+                            unsigned int index,
                             SampleType *proc,
                             unsigned int fftSize,
                             unsigned int offset)
  {
-  multiplyFFTs(proc, input, irKernel, fftSize);
+  kernels.multiply(proc, input, index, fftSize);
   ifftDynamicSize(proc, fftSize);
   unsigned int c = offset;
   {
@@ -1016,8 +2327,10 @@ class ConvolutionEngine
   
   for (int i = 0; i < imp->inputKernels.size(); ++i)
   {
+   if (imp->inputKernels.silent(i)) continue;
    multiplyAndAccumulate(inputBuffer.data(),
-                         imp->inputKernels.get(i),
+                         imp->inputKernels,
+                         i,
                          procBuffer.data(),
                          fftSize,
                          olapC + segmentSize*i);
@@ -1034,11 +2347,15 @@ class ConvolutionEngine
              0.);
    fftDynamicSize(deferProc[procBufferInUse].data(), cp.deferredFFTSize(), false);
    
-   multiplyAndAccumulate(deferProc[procBufferInUse].data(),
-                         imp->deferredKernels.get(0),
-                         deferBuffer.data(),
-                         cp.deferredFFTSize(),
-                         olapC + offset);
+   if (!imp->deferredKernels.silent(0))
+   {
+    multiplyAndAccumulate(deferProc[procBufferInUse].data(),
+                          imp->deferredKernels,
+                          0,
+                          deferBuffer.data(),
+                          cp.deferredFFTSize(),
+                          olapC + offset);
+   }
    deferOlapC = olapC + offset;
    procBufferInUse = 1 - procBufferInUse;
    startDeferredProcess = true;
@@ -1059,8 +2376,10 @@ class ConvolutionEngine
     startDeferredProcess = false;
     for (unsigned int i = 1; i < imp->deferredKernels.size(); ++i)
     {
+     if (imp->deferredKernels.silent(i)) continue;
      multiplyAndAccumulate(deferProc[pbu].data(),
-                           imp->deferredKernels.get(i),
+                           imp->deferredKernels,
+                           i,
                            deferBuffer.data(),
                            cp.deferredFFTSize(),
                            deferOlapC + cp.deferredSize()*i);
@@ -1128,6 +2447,18 @@ public:
   imp = &impulse;
  }
  
+ /**
+  * @brief Detach the impulse response, so that it can be changed safely.
+  * 
+  * This waits for any deferred processing using the impulse response to finish. Until another impulse response is set, processSamples leaves the output untouched.
+  */
+ void clearImpulseResponse()
+ {
+  std::unique_lock lock(dmux);
+  imp = nullptr;
+  startDeferredProcess = false;
+ }
+ 
  /**
   * @brief Initialise the convolution engine.
   * 
@@ -1225,112 +2556,781 @@ public:
 
 
 
-}
-
-
-
-
-
-
+/**
+ * @brief An internal class which encapsulates a convolution engine for a matrix of impulse responses, such as a true-stereo reverb.
+ * 
+ * Each input channel is transformed into the frequency domain once per block. For every output channel, the spectra of all the inputs are multiplied with the kernels of their paths and summed in the frequency domain, so each partition costs one inverse FFT per output regardless of how many inputs feed it.
+ * 
+ * @tparam InputCount The expected channel count of the input signal.
+ * @tparam OutputCount The number of output channels to produce.
+ */
+template <int InputCount, int OutputCount>
+class MatrixConvolutionEngine
+{
+ std::array<std::array<ImpulseResponse*, OutputCount>, InputCount> imp;
+ ConvolutionParameters &cp;
+ 
+ bool startDeferredProcess {false};
+ bool killDeferredProcess {false};
+ std::mutex dmux;
+ std::mutex amux;
+ std::condition_variable deferredProcessTrigger;
+ int procBufferInUse {0};
+ std::array<std::array<std::vector<SampleType>, 2>, InputCount> deferProc;
+ std::thread deferredProcThread;
+ 
+ std::array<std::vector<SampleType>, InputCount> inputBuffer;
+ std::vector<SampleType> deferBuffer;
+ std::vector<SampleType> procBuffer;
+ std::array<std::vector<SampleType>, OutputCount> olapBuffer;
+ unsigned int olapC {0};
+ unsigned int deferC {0};
+ unsigned int deferOlapC {0};
+ unsigned int inputPartitions {0};
+ unsigned int deferredPartitions {0};
+ PowerSize olapSize;
+ 
+ bool hasImpulse() const
+ {
+  for (auto &row : imp) for (auto ir : row) if (ir) return true;
+  return false;
+ }
+ 
+ void accumulatePartition(const std::array<SampleType*, InputCount> &spectra,
+                          bool deferred,
+                          unsigned int partition,
+                          int output,
+                          SampleType *proc,
+                          unsigned int fftSize,
+                          unsigned int offset)
+ {
+  bool active = false;
+  for (int c = 0; c < InputCount; ++c)
+  {
+   if (!imp[c][output]) continue;
+   KernelContainer &k = deferred ? imp[c][output]->deferredKernels : imp[c][output]->inputKernels;
+   if (partition >= k.size() || k.silent(partition)) continue;
+   if (active) k.multiplyAndAdd(proc, spectra[c], partition, fftSize);
+   else k.multiply(proc, spectra[c], partition, fftSize);
+   active = true;
+  }
+  if (!active) return;
+  
+  ifftDynamicSize(proc, fftSize);
+  unsigned int c = offset;
+  {
+   std::unique_lock lock(amux);
+   for (unsigned int j = 0; j < fftSize; j++, ++c)
+   {
+    olapBuffer[output][c & olapSize.mask()] += proc[j];
+   }
+  }
+ }
+ 
+ void doConvolution()
+ {
+  const unsigned int fftSize = cp.inputFFTSize();
+  const unsigned int segmentSize = cp.inputSize();
+  std::array<SampleType*, InputCount> spectra;
+  for (int c = 0; c < InputCount; ++c)
+  {
+   fftDynamicSize(inputBuffer[c].data(), fftSize, false);
+   spectra[c] = inputBuffer[c].data();
+  }
+  
+  for (unsigned int i = 0; i < inputPartitions; ++i)
+  {
+   for (int o = 0; o < OutputCount; ++o)
+   {
+    accumulatePartition(spectra, false, i, o, procBuffer.data(), fftSize, olapC + segmentSize*i);
+   }
+  }
+ }
+ 
+ void doDeferredConvolution(unsigned int offset)
+ {
+  {
+   std::unique_lock lock(dmux);
+   
+   std::array<SampleType*, InputCount> spectra;
+   for (int c = 0; c < InputCount; ++c)
+   {
+    std::vector<SampleType> &dp = deferProc[c][procBufferInUse];
+    std::fill(dp.begin() + cp.deferredSize(), dp.end(), 0.);
+    fftDynamicSize(dp.data(), cp.deferredFFTSize(), false);
+    spectra[c] = dp.data();
+   }
+   
+   for (int o = 0; o < OutputCount; ++o)
+   {
+    accumulatePartition(spectra, true, 0, o, deferBuffer.data(), cp.deferredFFTSize(), olapC + offset);
+   }
+   deferOlapC = olapC + offset;
+   procBufferInUse = 1 - procBufferInUse;
+   startDeferredProcess = true;
+  }
+  deferredProcessTrigger.notify_one();
+ }
+ 
+ void deferredProcessor()
+ {
+  std::unique_lock lock(dmux);
+  while (!killDeferredProcess)
+  {
+   deferredProcessTrigger.wait(lock, [&]() { return killDeferredProcess || startDeferredProcess; });
+   
+   if (startDeferredProcess)
+   {
+    int pbu = 1 - procBufferInUse;
+    startDeferredProcess = false;
+    std::array<SampleType*, InputCount> spectra;
+    for (int c = 0; c < InputCount; ++c) spectra[c] = deferProc[c][pbu].data();
+    for (unsigned int i = 1; i < deferredPartitions; ++i)
+    {
+     for (int o = 0; o < OutputCount; ++o)
+     {
+      accumulatePartition(spectra,
+                          true,
+                          i,
+                          o,
+                          deferBuffer.data(),
+                          cp.deferredFFTSize(),
+                          deferOlapC + cp.deferredSize()*i);
+     }
+    }
+   }
+  }
+ }
+ 
+public:
+ PConnector<InputCount> signalIn;
+ 
+ /**
+  * @brief Construct a new Matrix Convolution Engine object.
+  * 
+  * The convolution engine starts a thread upon construction. The thread waits on an internal structure for data to process.
+  * 
+  * @tparam Source The source of the connection, inferred from the parameter.
+  * @param cp The convolution parameters object.
+  * @param c The coupler to take input from.
+  */
+ template<typename Source>
+ MatrixConvolutionEngine(ConvolutionParameters &cp, Coupler<Source, InputCount> &c) :
+ cp(cp),
+ deferredProcThread([&]() {deferredProcessor();}),
+ signalIn(c)
+ {
+  for (auto &row : imp) row.fill(nullptr);
+ }
+ 
+ /**
+  * @brief Stop the processing thread, then destroy the Matrix Convolution Engine object.
+  * 
+  * Currently, this object waits for the processing thread to finish with no time out.
+  */
+ ~MatrixConvolutionEngine()
+ {
+  {
+   std::unique_lock lock(dmux);
+   killDeferredProcess = true;
+  }
+  deferredProcessTrigger.notify_one();
+  if (deferredProcThread.joinable()) deferredProcThread.join();
+ }
+ 
+ /**
+  * @brief Set the impulse response for one path through the matrix.
+  * 
+  * @param input The input channel of the path.
+  * @param output The output channel of the path.
+  * @param impulse A pointer to the impulse response, or nullptr to leave the path silent.
+  */
+ void setImpulseResponse(int input, int output, ImpulseResponse *impulse)
+ {
+  dsp_assert(input >= 0 && input < InputCount && output >= 0 && output < OutputCount);
+  std::unique_lock lock(dmux);
+  imp[input][output] = impulse;
+ }
+ 
+ /**
+  * @brief Detach every impulse response, so that they can be changed safely.
+  * 
+  * This waits for any deferred processing using the impulse responses to finish. Every path is silent until its impulse response is set again.
+  */
+ void clearImpulseResponses()
+ {
+  std::unique_lock lock(dmux);
+  for (auto &row : imp) row.fill(nullptr);
+  startDeferredProcess = false;
+ }
+ 
+ /**
+  * @brief Initialise the convolution engine.
+  * 
+  * Initialises and resets the convolution engine. This needs to be called whenever any of the convolution parameters or impulse responses are changed.
+  */
+ void initialise()
+ {
+  {
+   std::unique_lock lock(dmux);
+   procBuffer.resize(cp.deferredFFTSize());
+   deferBuffer.resize(cp.deferredFFTSize());
+   for (auto &ib : inputBuffer) ib.resize(cp.inputFFTSize());
+   for (auto &dp : deferProc)
+   {
+    dp[0].resize(cp.deferredFFTSize());
+    dp[1].resize(cp.deferredFFTSize());
+   }
+   
+   unsigned int longest = 0;
+   inputPartitions = deferredPartitions = 0;
+   for (auto &row : imp)
+   {
+    for (auto ir : row)
+    {
+     if (!ir) continue;
+     longest = std::max(longest, ir->sampleCount);
+     inputPartitions = std::max(inputPartitions, ir->inputKernels.size());
+     deferredPartitions = std::max(deferredPartitions, ir->deferredKernels.size());
+    }
+   }
+   
+   if (longest > 0)
+   {
+    unsigned int overlapSize = cp.deferredSize() + longest + cp.deferredFFTSize();
+    olapSize.setToNextPowerTwo(overlapSize);
+    for (auto &ob : olapBuffer) ob.resize(olapSize.size());
+   }
+  }
+  
+  reset();
+ }
+ 
+ /**
+  * @brief Reset the convolution engine.
+  * 
+  * Performs a quick reset. Call this to clear the internal buffers and reset the convolution process, without doing all the extra work needed when convolution parameters are changed.
+  */
+ void reset()
+ {
+  std::unique_lock lock(dmux);
+  deferC = 0;
+  procBufferInUse = 0;
+  if (hasImpulse())
+  {
+   for (auto &ob : olapBuffer) ob.assign(olapSize.size(), 0.);
+   olapC = 0;
+  }
+ }
+ 
+ /**
+  * @brief Process some samples from every input channel.
+  * 
+  * @param startPoint The start point in the input channels.
+  * @param output An array of pointers to the output buffers, one for each output channel.
+  * @param sampleCount How many samples to process.
+  */
+ void processSamples(int startPoint,
+                     const std::array<SampleType*, OutputCount> &output,
+                     unsigned int sampleCount)
+ {
+  if (hasImpulse())
+  {
+   const unsigned int inputFFTSize = cp.inputFFTSize();
+   const unsigned int deferredSize = cp.deferredSize();
+   
+   for (int c = 0; c < InputCount; ++c)
+   {
+    unsigned int i = 0;
+    for (; i < sampleCount; ++i) inputBuffer[c][i] = signalIn(c, i + startPoint);
+    for (; i < inputFFTSize; ++i) inputBuffer[c][i] = 0.;
+   }
+   
+   if (cp.deferredProcessing())
+   {
+    unsigned int i = 0;
+    for (; i < sampleCount && deferC < deferredSize; ++i, ++deferC)
+    {
+     for (int c = 0; c < InputCount; ++c) deferProc[c][procBufferInUse][deferC] = inputBuffer[c][i];
+    }
+    if (deferC == deferredSize)
+    {
+     deferC = 0;
+     doDeferredConvolution(i);
+     for (; i < sampleCount && deferC < deferredSize; ++i, ++deferC)
+     {
+      for (int c = 0; c < InputCount; ++c) deferProc[c][procBufferInUse][deferC] = inputBuffer[c][i];
+     }
+    }
+   }
+   
+   doConvolution();
+   
+   for (unsigned int i = 0; i < sampleCount; ++i)
+   {
+    for (int o = 0; o < OutputCount; ++o)
+    {
+     output[o][i] = olapBuffer[o][olapC];
+     olapBuffer[o][olapC] = 0.;
+    }
+    olapC = (olapC + 1) & olapSize.mask();
+   }
+  }
+ }
+};
+
+
+
+
+
+}
+
+
+
+
+
+
+
+
+
+/**
+ * @brief A component for performing convolution on an input signal.
+ * 
+ * This component can handle mono or multi-channel impulse responses. Upon construction, the convolution engine starts multiple threads to perform background processing on signal data. These threads are automatically stopped upon destruction of the component, however they currently wait on the stopping thread indefinitely, so a stuck thread might result in a hang.
+ * 
+ * @tparam SignalIn Couples to the input signal. Can have as many channels as you like.
+ */
+template <typename SignalIn>
+class ConvolutionFilter : public Component<ConvolutionFilter<SignalIn>>, public Parameters::ParameterListener
+{
+public:
+ static constexpr int Count = SignalIn::Count;
+
+private:
+ bool initialised = false;
+ 
+ int selectedFFTSize {256};
+ bool automaticFFTSize {false};
+ double tailThreshold {0.};
+ int kernelPrecision {ConvolutionEngine::KernelPrecision::Full};
+ ConvolutionEngine::FFTTuning tuning;
+ unsigned int kernelThreads {std::max(1u, std::thread::hardware_concurrency())};
+ Parameters &dsp;
+ ConvolutionEngine::ConvolutionParameters cp;
+ ConvolutionEngine::KernelCache kernelCache;
+ 
+ std::array<ConvolutionEngine::ImpulseSample, Count> samples;
+ std::vector<ConvolutionEngine::ImpulseResponse> imp;
+ std::vector<ConvolutionEngine::ConvolutionEngine<Count>> eng;
+ 
+ std::mutex mtx;
+ 
+public:
+ 
+ SignalIn signalIn;
+ 
+ Output<Count> signalOut;
+ 
+ /**
+  * @brief Called during initialisation with the number of impulse response kernels prepared so far and the total number to prepare.
+  * 
+  * It may be called from any of the threads preparing kernels, but never from two at once. It is called while the component is locked, so it must not call back into the component.
+  */
+ std::function<void (unsigned int, unsigned int)> onKernelProgress;
+ 
+ // Upon construction, the convolution engine starts multiple threads to perform background processing on signal data. These threads are automatically stopped upon destruction of the component, however they currently wait on the stopping thread indefinitely, so a stuck thread might result in a hang.
+ ConvolutionFilter(Parameters &p, SignalIn _signalIn) :
+ Parameters::ParameterListener(p),
+ dsp(p),
+ signalIn(_signalIn),
+ signalOut(p)
+ {
+  resetConvolution();
+  updateBufferSize(p.bufferSize());
+  // Moving an engine would leave its input connected to the engine it was moved from, so make room for every engine first
+  eng.reserve(Count);
+  for (int i = 0; i < Count; ++i)
+  {
+   eng.emplace_back(cp, signalIn);
+  }
+ }
+ 
+ void reset()
+ {
+  std::lock_guard<std::mutex> lock(mtx);
+  for (auto &e : eng) e.reset();
+  signalOut.reset();
+ }
+ 
+ /**
+  * @brief Clear the convolution engines, unload the impulse response samples and bypass the component.
+  * 
+  */
+ void resetConvolution()
+ {
+  std::lock_guard<std::mutex> lock(mtx);
+  initialised = false;
+  samples.fill(ConvolutionEngine::ImpulseSample());
+  imp.clear();
+  imp.assign(Count, ConvolutionEngine::ImpulseResponse());
+ }
+ 
+ /**
+  * @brief Set the impulse response data for one channel.
+  * 
+  * Set the impulse response samples with this method first, then call ConvolutionFilter::initialiseConvolution to load the impulse response samples into the convolution engine. You must load a sample into index 0 at a minimum otherwise initialisation will fail. Each index corresponds to a channel (ie. left/right/other). If any indexes are left empty, that channel is loaded with the sample in index 0 at initialisation.
+  * 
+  * @param index The index to load this sample into. There is one index for each channel.
+  * @param data A pointer to the sample data.
+  * @param length The length of the sample data.
+  */
+ void setImpulse(int index, SampleType* data, unsigned int length)
+ {
+  dsp_assert(index >= 0 && index < Count);
+  samples[index].set = data != nullptr;
+  samples[index].pointerToSample = data;
+  samples[index].length = length;
+ }
+ 
+ virtual void updateBufferSize(int bs) override
+ {
+  initialiseConvolution();
+ }
+
+ /**
+  * @brief Returns whether the convolution engine is fully initialised.
+  * 
+  * When the engine is fully initialised then convolution happens, otherwise this component will feed its input straight into its output.
+  * 
+  * @return true If it is initialised.
+  * @return false If it is not initialised.
+  */
+ bool isInitlialised() const { return initialised; }
+ 
+ /**
+  * @brief Set a hint for the FFT size to be used by the convolution engine.
+  * 
+  * The convolution engine uses FFT to speed up the convolution algorithm. Some systems may perform better with smaller or larger FFT size chunks. This method provides a way to set the FFT size in order to find the optimal size. Calling this will cause the engine to be reinitialised immediately.
+  * 
+  * @param hint A hint for the convolution engine about what might be the optimal size for the FFT. This can be any number, and the convolution engine might ignore the value. It is internally rounded to a power of 2.
+  */
+ void setFFTHint(unsigned int hint)
+ {
+  selectedFFTSize = hint;
+  automaticFFTSize = false;
+  initialiseConvolution();
+ }
+ 
+ /**
+  * @brief Return the current size of the FFT chunk being used by the convolution engine.
+  * 
+  * @return int The current size of the FFT chunk being used by the convolution engine. It may or may not be equal to the FFT hint provided.
+  */
+ int getFFTSize() const { return cp.deferredFFTSize(); }
+ 
+ /**
+  * @brief Let the convolution engine choose its own FFT size.
+  * 
+  * Each time the convolution is initialised, the cost of every candidate FFT size is measured on this machine, and the cheapest size which leaves enough time in each buffer is chosen. The decision is remembered for each CPU model, buffer size and impulse length, and is also stored in the kernel cache directory when one is set. Measuring takes a few tens of milliseconds when there is no remembered decision. Calling setFFTHint returns to a manual FFT size. Calling this will cause the engine to be reinitialised immediately.
+  */
+ void setAutomaticFFTSize()
+ {
+  automaticFFTSize = true;
+  initialiseConvolution();
+ }
+ 
+ /**
+  * @brief Return the decision made the last time the FFT size was chosen automatically.
+  * 
+  * @return const ConvolutionEngine::FFTTuning& The decision, which has an FFT hint of 0 if the FFT size was set manually.
+  */
+ const ConvolutionEngine::FFTTuning &getFFTTuning() const { return tuning; }
+ 
+ /**
+  * @brief Set the number of threads used to prepare the impulse response kernels.
+  * 
+  * Preparing the kernels of a long impulse response takes many FFTs, which are shared between this many threads during initialisation. The default is the number of hardware threads available. The new setting is used the next time the convolution is initialised.
+  * 
+  * @param threads The number of threads to use, including the thread which initialises the convolution.
+  */
+ void setKernelThreadCount(unsigned int threads)
+ { kernelThreads = std::max(1u, threads); }
+ 
+ /**
+  * @brief Set a directory in which to keep prepared impulse response kernels.
+  * 
+  * Preparing the kernels is the slowest part of initialisation. With a cache directory set, the prepared kernels are written to a file named after a hash of the impulse, the sample rate and the partition layout, and loaded from that file the next time the same impulse is initialised with the same settings. The directory is created if it does not exist. An empty path disables the cache, which is the default.
+  * 
+  * @param path The directory to keep the cache files in.
+  */
+ void setKernelCacheDirectory(const std::filesystem::path &path)
+ { kernelCache.setDirectory(path); }
+ 
+ /**
+  * @brief Set the level below which the tail of an impulse response is discarded.
+  * 
+  * Each impulse response is cut short at the point where the rest of it holds less than this fraction of its total energy, which removes padding and decay below the noise floor. Independently of this setting, partitions of the impulse response which are entirely silent are skipped during convolution and take no memory. The default of 0 dB disables truncation. The new setting is used the next time the convolution is initialised.
+  * 
+  * @param thresholddB The energy of the discarded tail relative to the energy of the whole impulse response, in decibels. For example, -120 dB.
+  */
+ void setTailThreshold(double thresholddB)
+ { tailThreshold = thresholddB; }
+ 
+ /**
+  * @brief Select how the impulse response kernels are stored.
+  * 
+  * Long impulse responses need a lot of kernel memory, and reading it is often the limit on how many convolutions can run at once. Storing the kernels as ConvolutionEngine::KernelPrecision::Half or ConvolutionEngine::KernelPrecision::BFloat16 halves the memory used by single precision kernels, and the kernels are widened as they are multiplied. Half precision typically keeps the kernels around 70 dB above the error it introduces, and bfloat16 around 50 dB. Use getKernelStorageReport to measure the effect on a particular impulse response. The new setting is used the next time the convolution is initialised.
+  * 
+  * @param precision The storage format, selected from ConvolutionEngine::KernelPrecision.
+  */
+ void setKernelPrecision(int precision)
+ { kernelPrecision = precision; }
+ 
+ /**
+  * @brief Report the memory used by the impulse response kernels and the accuracy they are stored with.
+  * 
+  * @return ConvolutionEngine::KernelStorageReport The report, summed over every channel.
+  */
+ ConvolutionEngine::KernelStorageReport getKernelStorageReport()
+ {
+  std::lock_guard<std::mutex> lock(mtx);
+  ConvolutionEngine::KernelStorageReport r;
+  if (initialised)
+  {
+   for (int i = 0; i < Count; ++i) if (samples[i].set) r += imp[i].storageReport();
+  }
+  return r;
+ }
+
+ /**
+  * @brief Prepare for convolution.
+  * 
+  * Call this method after setting all convolution parameters and loading the impulse response data. This must be called again if new impulse response data is loaded. It is automatically called whenever the buffer size or fft hints are changed.
+  */
+ void initialiseConvolution()
+ {
+  // Time the FFT sizes before taking the lock for the rest of the preparation, so that processing is not held up by the timing
+  ConvolutionEngine::FFTTuning newTuning;
+  if (automaticFFTSize)
+  {
+   unsigned int shortest = UINT_MAX;
+   unsigned int longest = 0;
+   {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (auto &sample : samples)
+    {
+     sample.truncate(tailThreshold);
+     if (sample.set)
+     {
+      shortest = std::min(shortest, sample.usedLength);
+      longest = std::max(longest, sample.usedLength);
+     }
+    }
+   }
+   if (longest > 0)
+   {
+    newTuning = ConvolutionEngine::FFTSizeTuner::tune(dsp.bufferSize(), dsp.sampleRate(),
+                                                      shortest, longest,
+                                                      Count, Count, Count,
+                                                      kernelCache.getDirectory());
+   }
+  }
+  
+  std::lock_guard<std::mutex> lock(mtx);
+  
+  // The engines may still be convolving the last block on their own threads, so detach them before the parameters and kernels are changed
+  for (auto &e : eng) e.clearImpulseResponse();
+  cp.setParameters(dsp.bufferSize(), selectedFFTSize);
+  
+  initialised = false;
+  tuning = ConvolutionEngine::FFTTuning();
+  if (!samples[0].set) return;
+  for (auto &sample : samples) sample.truncate(tailThreshold);
+  
+  if (automaticFFTSize && newTuning.fftHint > 0)
+  {
+   tuning = newTuning;
+   cp.setParameters(dsp.bufferSize(), tuning.fftHint);
+  }
+  
+  // Every channel must be partitioned the same way, so fit the parameters to the shortest impulse first
+  unsigned int totalKernels = 0;
+  for (auto &sample : samples) if (sample.set) cp.fitImpulseLength(sample.usedLength);
+  for (auto &sample : samples)
+  {
+   if (sample.set) totalKernels += ConvolutionEngine::ImpulseResponse::kernelCount(cp, sample.usedLength);
+  }
+  
+  unsigned int preparedKernels = 0;
+  ConvolutionEngine::KernelPreparation prep;
+  prep.threadCount = kernelThreads;
+  prep.precision = kernelPrecision;
+  if (onKernelProgress)
+  {
+   prep.onProgress = [&](unsigned int done, unsigned int) { onKernelProgress(preparedKernels + done, totalKernels); };
+  }
+  
+  for (int i = 0; i < Count; ++i)
+  {
+   if (samples[i].set)
+   {
+    kernelCache.prepare(imp[i], cp, samples[i].pointerToSample, samples[i].usedLength, dsp.sampleRate(), prep);
+    preparedKernels += ConvolutionEngine::ImpulseResponse::kernelCount(cp, samples[i].usedLength);
+    eng[i].setImpulseResponse(imp[i]);
+   }
+   else eng[i].setImpulseResponse(imp[0]);
+  }
+  
+  for (auto &e: eng) e.initialise();
+  
+  initialised = true;
+ }
+ 
+ void stepProcess(int startPoint, int sampleCount)
+ {
+  std::lock_guard<std::mutex> lock(mtx);
+  // If there are no kernels loaded, simply pass signal through
+  if (!initialised)
+  {
+   for (int c = 0; c < Count; ++c)
+   {
+    for (int i = startPoint, s = sampleCount; s--; ++i)
+    {
+     signalOut.buffer(c, i) = signalIn(c, i);
+    }
+   }
+  }
+  
+  // otherwise process the inputs
+  else
+  {
+   for (int c = 0; c < Count; ++c)
+   {
+    eng[c].processSamples(c,
+                          startPoint,
+                          signalOut.buffer[c] + startPoint,
+                          sampleCount);
+   }
+  }
+ }
+};
+
+
+
+
+
+
+
 
 
 
 /**
- * @brief A component for performing convolution on an input signal.
+ * @brief A component for performing matrix convolution, such as true-stereo reverb, on an input signal.
  * 
- * This component can handle mono or multi-channel impulse responses. Upon construction, the convolution engine starts multiple threads to perform background processing on signal data. These threads are automatically stopped upon destruction of the component, however they currently wait on the stopping thread indefinitely, so a stuck thread might result in a hang.
+ * Every input channel can be convolved with a separate impulse response for every output channel, and each output is the sum of all the paths feeding it. A true-stereo reverb uses four paths: left to left, right to left, left to right and right to right. The spectrum of each input channel is computed once and shared by all of its paths, and the paths are summed in the frequency domain before the inverse FFT. This makes it much cheaper than running one ConvolutionFilter per path.
+ * 
+ * Upon construction, the convolution engine starts a thread to perform background processing on signal data. The thread is automatically stopped upon destruction of the component, however it currently waits on the stopping thread indefinitely, so a stuck thread might result in a hang.
  * 
  * @tparam SignalIn Couples to the input signal. Can have as many channels as you like.
+ * @tparam OutputCount The number of output channels. Defaults to the number of input channels.
  */
-template <typename SignalIn>
-class ConvolutionFilter : public Component<ConvolutionFilter<SignalIn>>, public Parameters::ParameterListener
+template <typename SignalIn, int OutputCount = SignalIn::Count>
+class MatrixConvolutionFilter : public Component<MatrixConvolutionFilter<SignalIn, OutputCount>>, public Parameters::ParameterListener
 {
 public:
- static constexpr int Count = SignalIn::Count;
-
+ static constexpr int InputCount = SignalIn::Count;
+ static constexpr int Count = OutputCount;
+ 
 private:
  bool initialised = false;
  
- struct ImpulseSample
- {
-  bool set {false};
-  SampleType* pointerToSample {nullptr};
-  unsigned int length {0};
- };
- 
  int selectedFFTSize {256};
+ bool automaticFFTSize {false};
+ double tailThreshold {0.};
+ int kernelPrecision {ConvolutionEngine::KernelPrecision::Full};
+ ConvolutionEngine::FFTTuning tuning;
+ unsigned int kernelThreads {std::max(1u, std::thread::hardware_concurrency())};
  Parameters &dsp;
  ConvolutionEngine::ConvolutionParameters cp;
+ ConvolutionEngine::KernelCache kernelCache;
  
- std::array<ImpulseSample, Count> samples;
- std::vector<ConvolutionEngine::ImpulseResponse> imp;
- std::vector<ConvolutionEngine::ConvolutionEngine<Count>> eng;
+ std::array<std::array<ConvolutionEngine::ImpulseSample, OutputCount>, InputCount> samples;
+ std::array<std::array<ConvolutionEngine::ImpulseResponse, OutputCount>, InputCount> imp;
  
  std::mutex mtx;
  
 public:
- 
  SignalIn signalIn;
  
  Output<Count> signalOut;
  
- // Upon construction, the convolution engine starts multiple threads to perform background processing on signal data. These threads are automatically stopped upon destruction of the component, however they currently wait on the stopping thread indefinitely, so a stuck thread might result in a hang.
- ConvolutionFilter(Parameters &p, SignalIn _signalIn) :
+ /**
+  * @brief Called during initialisation with the number of impulse response kernels prepared so far and the total number to prepare.
+  * 
+  * It may be called from any of the threads preparing kernels, but never from two at once. It is called while the component is locked, so it must not call back into the component.
+  */
+ std::function<void (unsigned int, unsigned int)> onKernelProgress;
+ 
+private:
+ ConvolutionEngine::MatrixConvolutionEngine<InputCount, OutputCount> eng;
+ 
+public:
+ // Upon construction, the convolution engine starts a thread to perform background processing on signal data. This thread is automatically stopped upon destruction of the component, however it currently waits on the stopping thread indefinitely, so a stuck thread might result in a hang.
+ MatrixConvolutionFilter(Parameters &p, SignalIn _signalIn) :
  Parameters::ParameterListener(p),
  dsp(p),
  signalIn(_signalIn),
- signalOut(p)
+ signalOut(p),
+ eng(cp, signalIn)
  {
   resetConvolution();
   updateBufferSize(p.bufferSize());
-  for (int i = 0; i < Count; ++i)
-  {
-   eng.emplace_back(cp, signalIn);
-  }
  }
  
- void reset() override
+ void reset()
  {
   std::lock_guard<std::mutex> lock(mtx);
-  for (auto &e : eng) e.reset();
+  eng.reset();
   signalOut.reset();
  }
  
  /**
-  * @brief Clear the convolution engines, unload the impulse response samples and bypass the component.
+  * @brief Clear the convolution engine, unload the impulse response samples and bypass the component.
   * 
   */
  void resetConvolution()
  {
   std::lock_guard<std::mutex> lock(mtx);
   initialised = false;
-  samples.fill(ImpulseSample());
-  imp.clear();
-  imp.assign(Count, ConvolutionEngine::ImpulseResponse());
+  for (auto &row : samples) row.fill(ConvolutionEngine::ImpulseSample());
+  for (auto &row : imp) row.fill(ConvolutionEngine::ImpulseResponse());
  }
  
  /**
-  * @brief Set the impulse response data for one channel.
+  * @brief Set the impulse response data for one path through the matrix.
   * 
-  * Set the impulse response samples with this method first, then call ConvolutionFilter::initialiseConvolution to load the impulse response samples into the convolution engine. You must load a sample into index 0 at a minimum otherwise initialisation will fail. Each index corresponds to a channel (ie. left/right/other). If any indexes are left empty, that channel is loaded with the sample in index 0 at initialisation.
+  * Set the impulse response samples with this method first, then call MatrixConvolutionFilter::initialiseConvolution to load the impulse response samples into the convolution engine. Paths which are left empty are silent. At least one path must be set otherwise initialisation will fail.
   * 
-  * @param index The index to load this sample into. There is one index for each channel.
-  * @param data A pointer to the sample data.
+  * @param inputChannel The input channel which feeds this path.
+  * @param outputChannel The output channel which this path is summed into.
+  * @param data A pointer to the sample data, or nullptr to clear the path.
   * @param length The length of the sample data.
   */
- void setImpulse(int index, SampleType* data, unsigned int length)
+ void setImpulse(int inputChannel, int outputChannel, SampleType* data, unsigned int length)
  {
-  dsp_assert(index >= 0 && index < Count);
-  samples[index].set = data != nullptr;
-  samples[index].pointerToSample = data;
-  samples[index].length = length;
+  dsp_assert(inputChannel >= 0 && inputChannel < InputCount);
+  dsp_assert(outputChannel >= 0 && outputChannel < OutputCount);
+  ConvolutionEngine::ImpulseSample &sample = samples[inputChannel][outputChannel];
+  sample.set = data != nullptr;
+  sample.pointerToSample = data;
+  sample.length = length;
  }
  
- virtual void updateBufferSize(int bs) override
+ virtual void updateBufferSize(int /*bs*/) override
  {
   initialiseConvolution();
  }
-
+ 
  /**
   * @brief Returns whether the convolution engine is fully initialised.
   * 
@@ -1344,13 +3344,14 @@ public:
  /**
   * @brief Set a hint for the FFT size to be used by the convolution engine.
   * 
-  * The convolution engine uses FFT to speed up the convolution algorithm. Some systems may perform better with smaller or larger FFT size chunks. This method provides a way to set the FFT size in order to find the optimal size. Calling this will cause the engine to be reinitialised immediately.
+  * See ConvolutionFilter::setFFTHint. Calling this will cause the engine to be reinitialised immediately.
   * 
-  * @param hint A hint for the convolution engine about what might be the optimal size for the FFT. This can be any number, and the convolution engine might ignore the value. It is internally rounded to a power of 2.
+  * @param hint A hint for the convolution engine about what might be the optimal size for the FFT. It is internally rounded to a power of 2.
   */
  void setFFTHint(unsigned int hint)
  {
   selectedFFTSize = hint;
+  automaticFFTSize = false;
   initialiseConvolution();
  }
  
@@ -1360,7 +3361,84 @@ public:
   * @return int The current size of the FFT chunk being used by the convolution engine. It may or may not be equal to the FFT hint provided.
   */
  int getFFTSize() const { return cp.deferredFFTSize(); }
-
+ 
+ /**
+  * @brief Let the convolution engine choose its own FFT size.
+  * 
+  * See ConvolutionFilter::setAutomaticFFTSize. Calling this will cause the engine to be reinitialised immediately.
+  */
+ void setAutomaticFFTSize()
+ {
+  automaticFFTSize = true;
+  initialiseConvolution();
+ }
+ 
+ /**
+  * @brief Return the decision made the last time the FFT size was chosen automatically.
+  * 
+  * @return const ConvolutionEngine::FFTTuning& The decision, which has an FFT hint of 0 if the FFT size was set manually.
+  */
+ const ConvolutionEngine::FFTTuning &getFFTTuning() const { return tuning; }
+ 
+ /**
+  * @brief Set the number of threads used to prepare the impulse response kernels.
+  * 
+  * Preparing the kernels of a long impulse response takes many FFTs, which are shared between this many threads during initialisation. The default is the number of hardware threads available. The new setting is used the next time the convolution is initialised.
+  * 
+  * @param threads The number of threads to use, including the thread which initialises the convolution.
+  */
+ void setKernelThreadCount(unsigned int threads)
+ { kernelThreads = std::max(1u, threads); }
+ 
+ /**
+  * @brief Set a directory in which to keep prepared impulse response kernels.
+  * 
+  * Preparing the kernels is the slowest part of initialisation. With a cache directory set, the prepared kernels are written to a file named after a hash of the impulse, the sample rate and the partition layout, and loaded from that file the next time the same impulse is initialised with the same settings. The directory is created if it does not exist. An empty path disables the cache, which is the default.
+  * 
+  * @param path The directory to keep the cache files in.
+  */
+ void setKernelCacheDirectory(const std::filesystem::path &path)
+ { kernelCache.setDirectory(path); }
+ 
+ /**
+  * @brief Set the level below which the tail of an impulse response is discarded.
+  * 
+  * See ConvolutionFilter::setTailThreshold. The threshold is applied to each path separately.
+  * 
+  * @param thresholddB The energy of the discarded tail relative to the energy of the whole impulse response, in decibels. For example, -120 dB.
+  */
+ void setTailThreshold(double thresholddB)
+ { tailThreshold = thresholddB; }
+ 
+ /**
+  * @brief Select how the impulse response kernels are stored.
+  * 
+  * See ConvolutionFilter::setKernelPrecision. The new setting is used the next time the convolution is initialised.
+  * 
+  * @param precision The storage format, selected from ConvolutionEngine::KernelPrecision.
+  */
+ void setKernelPrecision(int precision)
+ { kernelPrecision = precision; }
+ 
+ /**
+  * @brief Report the memory used by the impulse response kernels and the accuracy they are stored with.
+  * 
+  * @return ConvolutionEngine::KernelStorageReport The report, summed over every path.
+  */
+ ConvolutionEngine::KernelStorageReport getKernelStorageReport()
+ {
+  std::lock_guard<std::mutex> lock(mtx);
+  ConvolutionEngine::KernelStorageReport r;
+  if (initialised)
+  {
+   for (int i = 0; i < InputCount; ++i)
+   {
+    for (int o = 0; o < OutputCount; ++o) if (samples[i][o].set) r += imp[i][o].storageReport();
+   }
+  }
+  return r;
+ }
+ 
  /**
   * @brief Prepare for convolution.
   * 
@@ -1368,28 +3446,105 @@ public:
   */
  void initialiseConvolution()
  {
+  unsigned int paths = 0;
+  unsigned int shortest = UINT_MAX;
+  unsigned int longest = 0;
+  auto measurePaths = [&]()
+  {
+   paths = 0;
+   shortest = UINT_MAX;
+   longest = 0;
+   for (auto &row : samples)
+   {
+    for (auto &sample : row)
+    {
+     sample.truncate(tailThreshold);
+     if (sample.set)
+     {
+      ++paths;
+      shortest = std::min(shortest, sample.usedLength);
+      longest = std::max(longest, sample.usedLength);
+     }
+    }
+   }
+  };
+  
+  // Time the FFT sizes before taking the lock for the rest of the preparation, so that processing is not held up by the timing
+  ConvolutionEngine::FFTTuning newTuning;
+  if (automaticFFTSize)
+  {
+   {
+    std::lock_guard<std::mutex> lock(mtx);
+    measurePaths();
+   }
+   if (paths > 0)
+   {
+    newTuning = ConvolutionEngine::FFTSizeTuner::tune(dsp.bufferSize(), dsp.sampleRate(),
+                                                      shortest, longest,
+                                                      InputCount, paths, OutputCount,
+                                                      kernelCache.getDirectory());
+   }
+  }
+  
   std::lock_guard<std::mutex> lock(mtx);
+  
+  // The engine may still be convolving the last block on its own thread, so detach it before the parameters and kernels are changed
+  eng.clearImpulseResponses();
   cp.setParameters(dsp.bufferSize(), selectedFFTSize);
   
   initialised = false;
-  if (!samples[0].set) return;
+  tuning = ConvolutionEngine::FFTTuning();
   
-  for (int i = 0; i < Count; ++i)
+  measurePaths();
+  if (paths == 0) return;
+  
+  if (automaticFFTSize && newTuning.fftHint > 0)
   {
-   if (samples[i].set)
+   tuning = newTuning;
+   cp.setParameters(dsp.bufferSize(), tuning.fftHint);
+  }
+  
+  // Every path must be partitioned the same way, so fit the parameters to the shortest one first
+  cp.fitImpulseLength(shortest);
+  
+  unsigned int totalKernels = 0;
+  for (auto &row : samples)
+  {
+   for (auto &sample : row)
    {
-    imp[i].setImpulseResponse(cp, samples[i].pointerToSample, samples[i].length);
-    eng[i].setImpulseResponse(imp[i]);
+    if (sample.set) totalKernels += ConvolutionEngine::ImpulseResponse::kernelCount(cp, sample.usedLength);
    }
-   else eng[i].setImpulseResponse(imp[0]);
   }
   
-  for (auto &e: eng) e.initialise();
+  unsigned int preparedKernels = 0;
+  ConvolutionEngine::KernelPreparation prep;
+  prep.threadCount = kernelThreads;
+  prep.precision = kernelPrecision;
+  if (onKernelProgress)
+  {
+   prep.onProgress = [&](unsigned int done, unsigned int) { onKernelProgress(preparedKernels + done, totalKernels); };
+  }
+  
+  for (int i = 0; i < InputCount; ++i)
+  {
+   for (int o = 0; o < OutputCount; ++o)
+   {
+    if (samples[i][o].set)
+    {
+     kernelCache.prepare(imp[i][o], cp, samples[i][o].pointerToSample, samples[i][o].usedLength, dsp.sampleRate(), prep);
+     preparedKernels += ConvolutionEngine::ImpulseResponse::kernelCount(cp, samples[i][o].usedLength);
+     eng.setImpulseResponse(i, o, &imp[i][o]);
+    }
+    else eng.setImpulseResponse(i, o, nullptr);
+   }
+  }
+  
+  eng.initialise();
   
   initialised = true;
  }
  
- void stepProcess(int startPoint, int sampleCount) override
+ void stepProcess(int startPoint, int sampleCount)
  {
   std::lock_guard<std::mutex> lock(mtx);
   // If there are no kernels loaded, simply pass signal through
@@ -1397,9 +3552,10 @@ public:
   {
    for (int c = 0; c < Count; ++c)
    {
+    const int inputChannel = std::min(c, InputCount - 1);
     for (int i = startPoint, s = sampleCount; s--; ++i)
     {
-     signalOut.buffer(c, i) = signalIn(c, i);
+     signalOut.buffer(c, i) = signalIn(inputChannel, i);
     }
    }
   }
@@ -1407,13 +3563,168 @@ public:
   // otherwise process the inputs
   else
   {
-   for (int c = 0; c < Count; ++c)
+   std::array<SampleType*, Count> output;
+   for (int c = 0; c < Count; ++c) output[c] = signalOut.buffer[c] + startPoint;
+   eng.processSamples(startPoint, output, sampleCount);
+  }
+ }
+};
+
+ 
+ 
+ 
+ 
+ 
+ 
+ 
+ 
+ 
+/**
+ * @brief A component which processes a signal in the frequency domain using a short-time Fourier transform.
+ * 
+ * The input is cut into overlapping frames of Size samples, starting a new frame every Hop samples. Each frame is multiplied by the analysis window and transformed, then the spectrum is passed to the onSpectrum callback to be modified in place. The spectrum is then transformed back, multiplied by the synthesis window and overlap-added into the output.
+ * 
+ * The synthesis window is normalised for the analysis window and hop size, so if the callback leaves the spectrum untouched then the output is the input delayed by Latency samples. The spectrum is in the format produced by XDDSP::fftDynamicSize, and XDDSP::getComplexSample can be used to read it.
+ * 
+ * All of the memory used is allocated on construction, and the FFTs use a precomputed FFTPlan.
+ * 
+ * @tparam SignalIn Couples to the input signal. Can have as many channels as you like.
+ * @tparam Size The length of each frame. Must be a power of 2.
+ * @tparam Hop The number of samples between the start of one frame and the next. Must be between 1 and Size. The default is a quarter of the frame size.
+ * @tparam Window The window function class from XDDSP::WindowFunction used for the default analysis and synthesis windows. The default sine window makes a Hann window once it is applied twice.
+ */
+template <typename SignalIn, int Size, int Hop = Size/4, typename Window = WindowFunction::Sine>
+class STFTProcessor : public Component<STFTProcessor<SignalIn, Size, Hop, Window>>
+{
+ static_assert(Size >= 4 && (Size & (Size - 1)) == 0, "STFTProcessor: Size must be a power of 2");
+ static_assert(Hop > 0 && Hop <= Size, "STFTProcessor: Hop must be between 1 and Size");
+ 
+public:
+ static constexpr int Count = SignalIn::Count;
+ 
+ /**
+  * @brief The delay between the input and the output in samples.
+  * 
+  */
+ static constexpr int Latency = Size - 1;
+ 
+private:
+ static constexpr int Mask = Size - 1;
+ 
+ FFTPlan plan;
+ std::vector<SampleType> analysisWindow;
+ std::vector<SampleType> synthesisWindow;
+ std::vector<SampleType> frame;
+ std::array<std::vector<SampleType>, Count> history;
+ std::array<std::vector<SampleType>, Count> overlap;
+ int historyPos {0};
+ int hopCount {0};
+ int outPos {0};
+ 
+ void processFrame(int channel)
+ {
+  // The history position points to the oldest sample
+  const std::vector<SampleType> &h = history[channel];
+  for (int n = 0; n < Size; ++n) frame[n] = h[(historyPos + n) & Mask]*analysisWindow[n];
+  
+  plan.forward(frame.data());
+  if (onSpectrum) onSpectrum(channel, frame.data());
+  plan.inverse(frame.data());
+  
+  std::vector<SampleType> &o = overlap[channel];
+  std::copy(o.begin() + Hop, o.end(), o.begin());
+  std::fill(o.end() - Hop, o.end(), 0.);
+  for (int n = 0; n < Size; ++n) o[n] = std::fma(frame[n], synthesisWindow[n], o[n]);
+ }
+ 
+public:
+ SignalIn signalIn;
+ 
+ Output<Count> signalOut;
+ 
+ /**
+  * @brief Called once for every channel of every frame with the spectrum of the frame, which may be modified in place.
+  * 
+  * The first parameter is the channel and the second points to Size values in the format produced by XDDSP::fftDynamicSize. The callback is called from stepProcess on the audio thread, so it must not allocate memory or block.
+  */
+ std::function<void (int, SampleType*)> onSpectrum;
+ 
+ STFTProcessor(Parameters &p, SignalIn _signalIn) :
+ plan(Size),
+ analysisWindow(Size),
+ synthesisWindow(Size),
+ frame(Size),
+ signalIn(_signalIn),
+ signalOut(p)
+ {
+  for (auto &h : history) h.resize(Size);
+  for (auto &o : overlap) o.resize(Size);
+  setWindows(Window(Size), Window(Size));
+  reset();
+ }
+ 
+ /**
+  * @brief Set the analysis and synthesis windows.
+  * 
+  * The windows are sampled over the length of the frame and the synthesis window is normalised so that the two windows overlap-add to unity at the hop size. The windows must not be zero everywhere that a sample is covered by a frame. This does not allocate memory, but it should not be called while the audio thread is running.
+  * 
+  * @tparam AnalysisWindow The class of the analysis window, inferred from the parameter.
+  * @tparam SynthesisWindow The class of the synthesis window, inferred from the parameter.
+  * @param analysis A window function object, such as one from XDDSP::WindowFunction, applied to frames before they are transformed.
+  * @param synthesis A window function object applied to frames after they are transformed back.
+  */
+ template <typename AnalysisWindow, typename SynthesisWindow>
+ void setWindows(AnalysisWindow analysis, SynthesisWindow synthesis)
+ {
+  for (int n = 0; n < Size; ++n)
+  {
+   analysisWindow[n] = analysis(n);
+   synthesisWindow[n] = synthesis(n);
+  }
+  
+  // Every output sample is covered by the frame positions which are a whole number of hops apart
+  for (int r = 0; r < Hop; ++r)
+  {
+   SampleType sum = 0.;
+   for (int n = r; n < Size; n += Hop) sum += analysisWindow[n]*synthesisWindow[n];
+   const SampleType norm = sum > 0. ? 1./sum : 0.;
+   for (int n = r; n < Size; n += Hop) synthesisWindow[n] *= norm;
+  }
+ }
+ 
+ /**
+  * @brief Return the delay between the input and the output in samples.
+  * 
+  * @return int The latency, which is the same as STFTProcessor::Latency.
+  */
+ int getLatency() const { return Latency; }
+ 
+ void reset()
+ {
+  for (auto &h : history) std::fill(h.begin(), h.end(), 0.);
+  for (auto &o : overlap) std::fill(o.begin(), o.end(), 0.);
+  historyPos = 0;
+  hopCount = 0;
+  outPos = 0;
+  signalOut.reset();
+ }
+ 
+ void stepProcess(int startPoint, int sampleCount)
+ {
+  for (int i = startPoint, s = sampleCount; s--; ++i)
+  {
+   for (int c = 0; c < Count; ++c) history[c][historyPos] = signalIn(c, i);
+   historyPos = (historyPos + 1) & Mask;
+   
+   if (++hopCount == Hop)
    {
-    eng[c].processSamples(c,
-                          startPoint,
-                          signalOut.buffer[c] + startPoint,
-                          sampleCount);
+    hopCount = 0;
+    outPos = 0;
+    for (int c = 0; c < Count; ++c) processFrame(c);
    }
+   
+   for (int c = 0; c < Count; ++c) signalOut.buffer(c, i) = overlap[c][outPos];
+   ++outPos;
   }
  }
 };
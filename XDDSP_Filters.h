@@ -10,8 +10,11 @@
 
 #include "XDDSP_BiquadKernel.h"
 #include "XDDSP_LinkwitzRileyKernel.h"
+#include "XDDSP_StateVariableFilterKernel.h"
+#include "XDDSP_IIRHilbertKernel.h"
 #include "XDDSP_WindowFunctions.h"
 #include "XDDSP_FFT.h"
+#include "XDDSP_FIRImpulses.h"
 
 
 
@@ -124,8 +127,10 @@ public:
 template <typename SignalIn>
 class StaticBiquad : public Component<StaticBiquad<SignalIn>>
 {
- // Private data members here
- std::array<BiquadFilterKernel, SignalIn::Count> flt;
+ static constexpr int Lanes = multichannelKernelLanes(SignalIn::Count);
+ 
+ // Filters with more than one channel process all of their channels together
+ std::conditional_t<(SignalIn::Count > 1), MultichannelBiquadKernel<Lanes>, std::array<BiquadFilterKernel, 1>> flt;
  
 public:
  static constexpr int Count = SignalIn::Count;
@@ -157,17 +162,28 @@ public:
  
  void reset()
  {
-  for (auto &f : flt) f.reset();
+  if constexpr (Count > 1) flt.reset();
+  else flt[0].reset();
   signalOut.reset();
  }
  
  void stepProcess(int startPoint, int sampleCount)
  {
-  for (int c = 0; c < Count; ++c)
+  if constexpr (Count > 1)
+  {
+   alignas(32) std::array<SampleType, Lanes> x {};
+   for (int i = startPoint, s = sampleCount; s--; ++i)
+   {
+    for (int c = 0; c < Count; ++c) x[c] = signalIn(c, i);
+    flt.process(coeff, x.data());
+    for (int c = 0; c < Count; ++c) signalOut.buffer(c, i) = x[c];
+   }
+  }
+  else
   {
    for (int i = startPoint, s = sampleCount; s--; ++i)
    {
-    signalOut.buffer(c, i) = flt[c].process(coeff, signalIn(c, i));
+    signalOut.buffer(0, i) = flt[0].process(coeff, signalIn(0, i));
    }
   }
  }
@@ -208,8 +224,39 @@ class DynamicBiquad : public Component<DynamicBiquad<SignalIn, FreqIn, QIn, Gain
  // Private data members here
  Parameters &dspParam;
 
- std::array<BiquadFilterKernel, SignalIn::Count> flt;
+ static constexpr int Lanes = multichannelKernelLanes(SignalIn::Count);
+ 
+ // Filters with more than one channel process all of their channels together
+ std::conditional_t<(SignalIn::Count > 1), MultichannelBiquadKernel<Lanes>, std::array<BiquadFilterKernel, 1>> flt;
  BiquadFilterCoefficients coeff;
+ 
+ // The coefficients used while interpolating, ramped from the last target to the next
+ BiquadFilterCoefficients ramp;
+ std::array<double, 5> rampFrom {};
+ bool interpolate {false};
+ bool rampPrimed {false};
+ 
+ void processSamples(const BiquadFilterCoefficients &k, int startPoint, int sampleCount)
+ {
+  if constexpr (Count > 1)
+  {
+   alignas(32) std::array<SampleType, Lanes> x {};
+   for (int i = startPoint, s = sampleCount; s--; ++i)
+   {
+    for (int c = 0; c < Count; ++c) x[c] = signalIn(c, i);
+    flt.process(k, x.data());
+    for (int c = 0; c < Count; ++c) signalOut.buffer(c, i) = x[c];
+   }
+  }
+  else
+  {
+   for (int i = startPoint, s = sampleCount; s--; ++i)
+   {
+    signalOut.buffer(0, i) = flt[0].process(k, signalIn(0, i));
+   }
+  }
+ }
+ 
 public:
  BiquadFilterPublicInterface interface;
  
@@ -229,6 +276,7 @@ public:
                GainIn gain) :
  dspParam(p),
  coeff(p),
+ ramp(p),
  interface(coeff),
  signalIn(signalIn),
  frequency(frequency),
@@ -240,9 +288,32 @@ public:
  void reset()
  {
   signalOut.reset();
-  for (auto &f : flt) f.reset();
+  if constexpr (Count > 1) flt.reset();
+  else flt[0].reset();
+  rampPrimed = false;
+ }
+ 
+ /**
+  * @brief Enable or disable interpolation of the filter coefficients.
+  * 
+  * Without interpolation, the coefficients change once every StepSize samples, which can be heard as zipper noise when the inputs move quickly. With interpolation, each coefficient moves in a straight line from one step to the next, one sample at a time. Any mode which is stable at both ends of a step is stable all the way along it.
+  * 
+  * @param enabled Set true to interpolate the coefficients.
+  */
+ void setCoefficientInterpolation(bool enabled)
+ {
+  interpolate = enabled;
+  rampPrimed = false;
  }
  
+ /**
+  * @brief Enable or disable fast approximations of the functions used to calculate the coefficients. See BiquadFilterCoefficients::setFastApproximation.
+  * 
+  * @param enabled Set true to use the approximations.
+  */
+ void setFastApproximation(bool enabled)
+ { coeff.setFastApproximation(enabled); }
+ 
  /**
   * @brief Set the mode of the filter. See BiquadFilterCoefficients for a list of modes.
   * 
@@ -261,15 +332,223 @@ public:
  
  void stepProcess(int startPoint, int sampleCount)
  {
-  coeff.setAllFilterParams(frequency(0, startPoint),
-                           qFactor(0, startPoint),
-                           gain(0, startPoint));
+  // When interpolating, the ramp ends on the inputs at the end of the step so that it does not lag behind them
+  const int controlPoint = interpolate ? startPoint + sampleCount - 1 : startPoint;
+  coeff.setAllFilterParams(frequency(0, controlPoint),
+                           qFactor(0, controlPoint),
+                           gain(0, controlPoint));
+  
+  if (!interpolate)
+  {
+   processSamples(coeff, startPoint, sampleCount);
+   return;
+  }
+  
+  const std::array<double, 5> target = coeff.getCoefficients();
+  if (!rampPrimed)
+  {
+   rampFrom = target;
+   rampPrimed = true;
+  }
+  if (ramp.isCascade() != coeff.isCascade()) ramp.setCascade(coeff.isCascade());
   
+  const double increment = 1./sampleCount;
+  for (int i = startPoint, s = 1; s <= sampleCount; ++i, ++s)
+  {
+   const double t = s*increment;
+   ramp.setCustomFilter(rampFrom[0] + t*(target[0] - rampFrom[0]),
+                        rampFrom[1] + t*(target[1] - rampFrom[1]),
+                        rampFrom[2] + t*(target[2] - rampFrom[2]),
+                        rampFrom[3] + t*(target[3] - rampFrom[3]),
+                        rampFrom[4] + t*(target[4] - rampFrom[4]));
+   processSamples(ramp, i, 1);
+  }
+  rampFrom = target;
+ }
+};
+
+
+
+
+
+
+
+
+
+
+/**
+ * @brief A component encapsulating a cascade of biquad filters, suitable for high order filters and multi-band equalisers.
+ * 
+ * Each stage has its own exposed coefficients object. All of the stages are run over each block in a single pass with the filter state held in registers, which is much faster than connecting a chain of StaticBiquad components.
+ * 
+ * @tparam SignalIn Couples to the input signal. Can have as many channels as you like.
+ * @tparam Stages The number of biquad stages.
+ * @tparam DoublePrecision Set true to run the transposed direct form II sections entirely in double precision, which improves stability and noise for filters at low frequencies. The default is false.
+ */
+template <typename SignalIn, int Stages, bool DoublePrecision = false>
+class BiquadCascade : public Component<BiquadCascade<SignalIn, Stages, DoublePrecision>>
+{
+ std::array<BiquadCascadeKernel<Stages, std::conditional_t<DoublePrecision, double, SampleType>>, SignalIn::Count> flt;
+ 
+public:
+ static constexpr int Count = SignalIn::Count;
+ 
+ /**
+  * @brief The exposed filter configuration objects, one for each stage.
+  * 
+  */
+ std::array<BiquadFilterCoefficients, Stages> coeff;
+ 
+ SignalIn signalIn;
+ 
+ Output<Count> signalOut;
+ 
+ BiquadCascade(Parameters &p, SignalIn signalIn) :
+ coeff(makeComponentArray<Stages, BiquadFilterCoefficients>(p)),
+ signalIn(signalIn),
+ signalOut(p)
+ {
+  reset();
+ }
+ 
+ /**
+  * @brief Calculate the frequency response of the whole cascade at some frequency.
+  * 
+  * @param hz The frequency to calculate for.
+  * @return std::complex<double> A complex number representing the amplitude and phase response of the filter.
+  */
+ std::complex<double> filterResponseAtHz(SampleType hz)
+ {
+  std::complex<double> result {1., 0.};
+  for (auto &k : coeff) result *= k.filterResponseAtHz(hz);
+  return result;
+ }
+ 
+ /**
+  * @brief Calculate the amplitude response of the whole cascade at some frequency.
+  * 
+  * @param hz The frequency to calculate for.
+  * @return SampleType The response of the frequency as a multiplier (use linear2dB to convert to decibels).
+  */
+ SampleType calculateMagnitudeResponseAtHz(SampleType hz)
+ {
+  return std::abs(filterResponseAtHz(hz));
+ }
+ 
+ void reset()
+ {
+  for (auto &f : flt) f.reset();
+  signalOut.reset();
+ }
+ 
+ void stepProcess(int startPoint, int sampleCount)
+ {
   for (int c = 0; c < Count; ++c)
   {
-   for (int i = startPoint, s = sampleCount; s--; ++i)
+   SampleType *out = signalOut.buffer[c];
+   for (int i = startPoint, s = sampleCount; s--; ++i) out[i] = signalIn(c, i);
+   flt[c].process(coeff, out + startPoint, sampleCount);
+  }
+ }
+};
+
+
+
+
+
+
+
+
+
+
+/**
+ * @brief A component encapsulating a state variable filter which can be modulated every sample.
+ * 
+ * The filter uses the topology-preserving transform with zero-delay feedback, so it stays stable and free of zipper noise while its frequency and resonance change at audio rate. Computing the coefficients costs one approximated tangent and one division per sample, which is far cheaper than reconfiguring a biquad every sample. All of the channels are processed together in vector lanes.
+ * 
+ * Low pass, band pass, high pass and notch outputs are all produced at once. The band pass output has unity gain at the cutoff frequency.
+ * 
+ * @tparam SignalIn Couples to the input signal. Can have as many channels as you like.
+ * @tparam FreqIn Couples to the signal providing the cutoff frequency in Hz. Must either have one channel or the same number of channels as SignalIn.
+ * @tparam QIn Couples to the signal providing the quality factor, which controls the resonance. Must either have one channel or the same number of channels as SignalIn.
+ */
+template <typename SignalIn, typename FreqIn, typename QIn>
+class StateVariableFilter : public Component<StateVariableFilter<SignalIn, FreqIn, QIn>>
+{
+ static_assert(FreqIn::Count == 1 || FreqIn::Count == SignalIn::Count, "StateVariableFilter: FreqIn must either have one channel or the same number of channels as SignalIn");
+ static_assert(QIn::Count == 1 || QIn::Count == SignalIn::Count, "StateVariableFilter: QIn must either have one channel or the same number of channels as SignalIn");
+ 
+ static constexpr int Lanes = (SignalIn::Count == 1) ? 1 : multichannelKernelLanes(SignalIn::Count);
+ static constexpr bool MultiFreq = (FreqIn::Count == SignalIn::Count);
+ static constexpr bool MultiQ = (QIn::Count == SignalIn::Count);
+ 
+ Parameters &dspParam;
+ StateVariableFilterKernel<Lanes> flt;
+ 
+public:
+ static constexpr int Count = SignalIn::Count;
+ 
+ SignalIn signalIn;
+ FreqIn frequency;
+ QIn qFactor;
+ 
+ Output<Count> lowPassOut;
+ Output<Count> bandPassOut;
+ Output<Count> highPassOut;
+ Output<Count> notchOut;
+ 
+ StateVariableFilter(Parameters &p, SignalIn signalIn, FreqIn frequency, QIn qFactor) :
+ dspParam(p),
+ signalIn(signalIn),
+ frequency(frequency),
+ qFactor(qFactor),
+ lowPassOut(p),
+ bandPassOut(p),
+ highPassOut(p),
+ notchOut(p)
+ {}
+ 
+ void reset()
+ {
+  flt.reset();
+  lowPassOut.reset();
+  bandPassOut.reset();
+  highPassOut.reset();
+  notchOut.reset();
+ }
+ 
+ void stepProcess(int startPoint, int sampleCount)
+ {
+  const SampleType isr = dspParam.sampleInterval();
+  alignas(32) std::array<SampleType, Lanes> g {};
+  alignas(32) std::array<SampleType, Lanes> k {};
+  alignas(32) std::array<SampleType, Lanes> x {};
+  alignas(32) std::array<SampleType, Lanes> low;
+  alignas(32) std::array<SampleType, Lanes> band;
+  alignas(32) std::array<SampleType, Lanes> high;
+  
+  for (int i = startPoint, s = sampleCount; s--; ++i)
+  {
+   if constexpr (MultiFreq)
    {
-    signalOut.buffer(c, i) = flt[c].process(coeff, signalIn(c, i));
+    for (int c = 0; c < Count; ++c) g[c] = StateVariableFilterKernel<Lanes>::frequencyCoefficient(frequency(c, i), isr);
+   }
+   else g.fill(StateVariableFilterKernel<Lanes>::frequencyCoefficient(frequency(0, i), isr));
+   
+   if constexpr (MultiQ)
+   {
+    for (int c = 0; c < Count; ++c) k[c] = StateVariableFilterKernel<Lanes>::dampingCoefficient(qFactor(c, i));
+   }
+   else k.fill(StateVariableFilterKernel<Lanes>::dampingCoefficient(qFactor(0, i)));
+   
+   for (int c = 0; c < Count; ++c) x[c] = signalIn(c, i);
+   flt.process(g.data(), k.data(), x.data(), low.data(), band.data(), high.data());
+   for (int c = 0; c < Count; ++c)
+   {
+    lowPassOut.buffer(c, i) = low[c];
+    bandPassOut.buffer(c, i) = band[c];
+    highPassOut.buffer(c, i) = high[c];
+    notchOut.buffer(c, i) = low[c] + high[c];
    }
   }
  }
@@ -294,7 +573,10 @@ public:
 template <typename SignalIn>
 class CrossoverFilter : public Component<CrossoverFilter<SignalIn>>
 {
- std::array<LinkwitzRileyFilterKernel, SignalIn::Count> flt;
+ static constexpr int Lanes = multichannelKernelLanes(SignalIn::Count);
+ 
+ // Filters with more than one channel process all of their channels together
+ std::conditional_t<(SignalIn::Count > 1), MultichannelLinkwitzRileyKernel<Lanes>, std::array<LinkwitzRileyFilterKernel, 1>> flt;
  
 public:
  static constexpr int Count = SignalIn::Count;
@@ -316,16 +598,164 @@ public:
  {
   lowPassOut.reset();
   highPassOut.reset();
-  for (auto &f : flt) f.reset();
+  if constexpr (Count > 1) flt.reset();
+  else flt[0].reset();
  }
  
  void stepProcess(int startPoint, int sampleCount)
  {
-  for (int c = 0; c < Count; ++c)
+  if constexpr (Count > 1)
+  {
+   alignas(32) std::array<SampleType, Lanes> x {};
+   alignas(32) std::array<SampleType, Lanes> low;
+   alignas(32) std::array<SampleType, Lanes> high;
+   for (int i = startPoint, s = sampleCount; s--; ++i)
+   {
+    for (int c = 0; c < Count; ++c) x[c] = signalIn(c, i);
+    flt.process(coeff, low.data(), high.data(), x.data());
+    for (int c = 0; c < Count; ++c)
+    {
+     lowPassOut.buffer(c, i) = low[c];
+     highPassOut.buffer(c, i) = high[c];
+    }
+   }
+  }
+  else
   {
    for (int i = startPoint, s = sampleCount; s--; ++i)
    {
-    flt[c].process(coeff, lowPassOut.buffer(c, i), highPassOut.buffer(c, i), signalIn(c, i));
+    flt[0].process(coeff, lowPassOut.buffer(0, i), highPassOut.buffer(0, i), signalIn(0, i));
+   }
+  }
+ }
+};
+
+
+
+
+
+
+
+
+
+
+/**
+ * @brief A component which splits a signal into several bands with a tree of Linkwitz-Riley crossovers, all computed in one pass.
+ * 
+ * The signal is split at the lowest crossover frequency first, then the upper part is split again at the next crossover frequency and so on. Each band below the top split is passed through an all pass filter for every crossover above it, so all the bands have the same phase response and sum back to a flat magnitude response. The intermediate signals are kept in local arrays instead of in output buffers, and every filter processes all of the channels together.
+ * 
+ * Each fourth order Linkwitz-Riley filter is built from two second order Butterworth sections, and every section keeps its state in double precision. A single fourth order section in single precision is not stable enough for crossovers below a few hundred Hz, while this keeps the sum of the bands flat to within 0.001dB with crossovers as low as 20Hz.
+ * 
+ * The crossover frequencies must be kept in ascending order.
+ * 
+ * @tparam SignalIn Couples to the input signal. Can have as many channels as you like.
+ * @tparam Bands The number of bands to split the signal into. Must be at least 2.
+ */
+template <typename SignalIn, int Bands>
+class MultibandCrossover : public Component<MultibandCrossover<SignalIn, Bands>>
+{
+ static_assert(Bands >= 2, "MultibandCrossover: There must be at least two bands");
+ 
+ static constexpr int Lanes = (SignalIn::Count == 1) ? 1 : multichannelKernelLanes(SignalIn::Count);
+ static constexpr int Splits = Bands - 1;
+ static constexpr int AllPassCount = (Bands - 1)*(Bands - 2)/2;
+ 
+ std::array<SampleType, Splits> frequencies;
+ std::array<BiquadFilterCoefficients, Splits> lowPassCoeff;
+ std::array<BiquadFilterCoefficients, Splits> highPassCoeff;
+ 
+ // The all pass filters used for compensation, one for each split above the lowest
+ std::array<BiquadFilterCoefficients, Splits - 1> allPassCoeff;
+ 
+ std::array<MultichannelBiquadKernel<Lanes, double>, Splits> lowPass;
+ std::array<MultichannelBiquadKernel<Lanes, double>, Splits> highPass;
+ std::array<MultichannelBiquadKernel<Lanes, double>, AllPassCount> compensator;
+ 
+public:
+ static constexpr int Count = SignalIn::Count;
+ 
+ SignalIn signalIn;
+ 
+ std::array<Output<Count>, Bands> bandOut;
+ 
+ MultibandCrossover(Parameters &p, SignalIn signalIn) :
+ lowPassCoeff(makeComponentArray<Splits, BiquadFilterCoefficients>(p)),
+ highPassCoeff(makeComponentArray<Splits, BiquadFilterCoefficients>(p)),
+ allPassCoeff(makeComponentArray<Splits - 1, BiquadFilterCoefficients>(p)),
+ signalIn(signalIn),
+ bandOut(make_array<Bands>(Output<Count>(p)))
+ {
+  for (auto &c : lowPassCoeff) c.setCascade(true);
+  for (auto &c : highPassCoeff) c.setCascade(true);
+  
+  // Spread the crossover frequencies evenly in pitch between 100Hz and 10kHz
+  for (int j = 0; j < Splits; ++j)
+  {
+   setCrossoverFrequency(j, 100.*pow(100., static_cast<SampleType>(j + 1)/Bands));
+  }
+ }
+ 
+ /**
+  * @brief Set the frequency of one of the crossovers.
+  * 
+  * @param index The index of the crossover, with 0 being the crossover between the lowest two bands.
+  * @param frequency The crossover frequency in Hz.
+  */
+ void setCrossoverFrequency(int index, SampleType frequency)
+ {
+  dsp_assert(index >= 0 && index < Splits);
+  frequencies[index] = frequency;
+  
+  // A Linkwitz-Riley filter is two Butterworth filters in series. A cascade uses the square root of the Q for each section, so 0.5 gives each section a Q of 1/sqrt(2)
+  lowPassCoeff[index].setLowPassFilter(frequency, 0.5);
+  highPassCoeff[index].setHighPassFilter(frequency, 0.5);
+  
+  // The sum of the outputs of a Linkwitz-Riley crossover is a second order all pass filter with a Q of 1/sqrt(2)
+  if (index > 0) allPassCoeff[index - 1].setAllPassFilter(frequency, M_SQRT1_2);
+ }
+ 
+ /**
+  * @brief Get the frequency of one of the crossovers.
+  * 
+  * @param index The index of the crossover, with 0 being the crossover between the lowest two bands.
+  * @return SampleType The crossover frequency in Hz.
+  */
+ SampleType getCrossoverFrequency(int index)
+ {
+  dsp_assert(index >= 0 && index < Splits);
+  return frequencies[index];
+ }
+ 
+ void reset()
+ {
+  for (auto &b : bandOut) b.reset();
+  for (auto &l : lowPass) l.reset();
+  for (auto &h : highPass) h.reset();
+  for (auto &c : compensator) c.reset();
+ }
+ 
+ void stepProcess(int startPoint, int sampleCount)
+ {
+  alignas(32) std::array<SampleType, Lanes> upper {};
+  alignas(32) std::array<std::array<SampleType, Lanes>, Bands> band;
+  
+  for (int i = startPoint, s = sampleCount; s--; ++i)
+  {
+   for (int c = 0; c < Count; ++c) upper[c] = signalIn(c, i);
+   
+   int a = 0;
+   for (int j = 0; j < Splits; ++j)
+   {
+    band[j] = upper;
+    lowPass[j].process(lowPassCoeff[j], band[j].data());
+    highPass[j].process(highPassCoeff[j], upper.data());
+    for (int k = j + 1; k < Splits; ++k) compensator[a++].process(allPassCoeff[k - 1], band[j].data());
+   }
+   band[Splits] = upper;
+   
+   for (int b = 0; b < Bands; ++b)
+   {
+    for (int c = 0; c < Count; ++c) bandOut[b].buffer(c, i) = band[b][c];
    }
   }
  }
@@ -349,7 +779,7 @@ public:
  * @tparam FIRTapCount Controls the size of the fir kernel used. **The tap count must be an odd number**. The default is 31.
  */
 template <typename SignalIn, int FIRTapCount = 31>
-class FIRHilbertTransform : public Component<FIRHilbertTransform<SignalIn>>
+class FIRHilbertTransform : public Component<FIRHilbertTransform<SignalIn, FIRTapCount>>
 {
  static_assert(FIRTapCount % 2 == 1, "FIRHilbertTransform: Tap Count must be odd");
  
@@ -358,6 +788,7 @@ class FIRHilbertTransform : public Component<FIRHilbertTransform<SignalIn>>
  std::array<DynamicCircularBuffer<>, SignalIn::Count> buffer;
  
  static constexpr SampleType alpha = 25.0/46.0;
+ static constexpr int BlockSize = 64;
 public:
  static constexpr int DelayLength = FIRTapCount/2;
  static constexpr int Count = SignalIn::Count;
@@ -374,8 +805,8 @@ public:
  {
   for (auto &b: buffer)
   {
-   b.setMaximumLength(FIRTapCount);
-   b.reset();
+   b.setMaximumLength(FIRTapCount + BlockSize);
+   b.reset(0.);
   }
   
   taps.fill(0.0);
@@ -396,20 +827,37 @@ public:
  
  void stepProcess(int startPoint, int sampleCount)
  {
+  alignas(32) std::array<SampleType, BlockSize> x;
+  alignas(32) std::array<SampleType, BlockSize> acc;
+  alignas(32) std::array<SampleType, FIRTapCount - 1 + BlockSize> window;
+  
   for (int c = 0; c < Count; ++c)
   {
-   for (int i = startPoint, s = sampleCount; s--; ++i)
+   for (int i = startPoint, s = sampleCount; s > 0;)
    {
-    SampleType x = 0.;
-    buffer[c].tapIn(signalIn(c, i));
+    const int n = std::min(s, BlockSize);
+    for (int j = 0; j < n; ++j) x[j] = signalIn(c, i + j);
+    
+    // The window holds the block and the history before it, so tapOut(t) for sample j is window[j + FIRTapCount - 1 - t]
+    buffer[c].write(x.data(), n);
+    buffer[c].read(0, window.data(), FIRTapCount - 1 + n);
     
+    std::fill(acc.begin(), acc.begin() + n, 0.);
     for (int t = 0; t < FIRTapCount; t += 2)
     {
-     x = std::fma(buffer[c].tapOut(t), taps[t], x);
+     const SampleType k = taps[t];
+     const SampleType *w = window.data() + FIRTapCount - 1 - t;
+     for (int j = 0; j < n; ++j) acc[j] = std::fma(w[j], k, acc[j]);
     }
     
-    inPhaseOut.buffer(c, i) = buffer[c].tapOut(DelayLength);
-    quadratureOut.buffer(c, i) = x;
+    for (int j = 0; j < n; ++j)
+    {
+     inPhaseOut.buffer(c, i + j) = window[j + FIRTapCount - 1 - DelayLength];
+     quadratureOut.buffer(c, i + j) = acc[j];
+    }
+    
+    i += n;
+    s -= n;
    }
   }
  }
@@ -424,6 +872,282 @@ public:
 
 
 
+/**
+ * @brief The types of kernel which FIRFilter recognises and processes with fewer multiplications.
+ * 
+ */
+struct FIRKernelType
+{
+ enum
+ {
+  /// A kernel with no symmetry, which takes one multiplication per tap.
+  General = 0,
+  
+  /// A linear phase kernel where each tap equals its mirror image, which takes half the multiplications.
+  Symmetric,
+  
+  /// A linear phase kernel where each tap is the negative of its mirror image, which takes half the multiplications.
+  Antisymmetric,
+  
+  /// A symmetric kernel with an odd length where every second tap away from the centre is zero, which takes a quarter of the multiplications.
+  HalfBand
+ };
+};
+
+
+
+
+
+
+
+
+
+
+/**
+ * @brief A component encapsulating a general purpose FIR filter.
+ * 
+ * The history of each channel is kept in a buffer twice the length of the kernel, with every sample written twice, so that the last samples are always contiguous in memory. A second copy is kept newest first, so that the folded halves of linear phase kernels can both be read forwards. Each output is a dot product summed with sumTerms, which the compiler can vectorise.
+ * 
+ * When the kernel is set, it is inspected for symmetry. Symmetric and antisymmetric kernels, which are the linear phase kernels, are processed by folding the history about its centre, halving the number of multiplications. Half-band kernels skip their zero taps as well.
+ * 
+ * Kernels can be made with the impulses in XDDSP_FIRImpulses.h, either by passing the impulse object to generateKernel or by passing a kernel made by generateImpulseResponse to setKernel.
+ * 
+ * @tparam SignalIn Couples to the input signal. Can have as many channels as you like.
+ * @tparam MaxTaps The largest kernel the filter can hold. The default is 63.
+ */
+template <typename SignalIn, int MaxTaps = 63>
+class FIRFilter : public Component<FIRFilter<SignalIn, MaxTaps>>
+{
+ static_assert(MaxTaps > 0, "FIRFilter: MaxTaps must be positive");
+ 
+ // The kernel is stored reversed, so that it lines up with the history which is stored oldest first
+ std::array<SampleType, MaxTaps> kernel;
+ std::array<std::array<SampleType, 2*MaxTaps>, SignalIn::Count> history;
+ std::array<std::array<SampleType, 2*MaxTaps>, SignalIn::Count> reversedHistory;
+ int length {1};
+ int position {0};
+ int type {FIRKernelType::General};
+ 
+ void classifyKernel()
+ {
+  SampleType peak = 0.;
+  for (int t = 0; t < length; ++t) peak = std::max(peak, std::abs(kernel[t]));
+  const SampleType tolerance = 16.*std::numeric_limits<SampleType>::epsilon()*peak;
+  
+  bool symmetric = true;
+  bool antisymmetric = true;
+  for (int t = 0; t < length/2; ++t)
+  {
+   const SampleType a = kernel[t];
+   const SampleType b = kernel[length - t - 1];
+   if (std::abs(a - b) > tolerance) symmetric = false;
+   if (std::abs(a + b) > tolerance) antisymmetric = false;
+  }
+  if (length % 2 == 1 && std::abs(kernel[length/2]) > tolerance) antisymmetric = false;
+  
+  bool halfBand = symmetric && length % 2 == 1 && length > 3;
+  for (int t = length/2 - 2; halfBand && t >= 0; t -= 2)
+  {
+   if (std::abs(kernel[t]) > tolerance) halfBand = false;
+  }
+  
+  if (halfBand) type = FIRKernelType::HalfBand;
+  else if (symmetric && length > 1) type = FIRKernelType::Symmetric;
+  else if (antisymmetric && length > 1) type = FIRKernelType::Antisymmetric;
+  else type = FIRKernelType::General;
+ }
+ 
+public:
+ static constexpr int Count = SignalIn::Count;
+ 
+ SignalIn signalIn;
+ 
+ Output<Count> signalOut;
+ 
+ FIRFilter(Parameters &p, SignalIn _signalIn) :
+ signalIn(_signalIn),
+ signalOut(p)
+ {
+  kernel.fill(0.);
+  kernel[0] = 1.;
+  reset();
+ }
+ 
+ /**
+  * @brief Set the kernel of the filter.
+  * 
+  * Setting a kernel of a different length clears the history of the filter.
+  * 
+  * @param taps A pointer to the kernel, with the tap for the current sample first.
+  * @param tapCount The length of the kernel. Kernels longer than MaxTaps are truncated.
+  */
+ void setKernel(const SampleType *taps, int tapCount)
+ {
+  tapCount = std::max(1, std::min(MaxTaps, tapCount));
+  for (int t = 0; t < tapCount; ++t) kernel[t] = taps[tapCount - t - 1];
+  if (tapCount != length)
+  {
+   length = tapCount;
+   reset();
+  }
+  classifyKernel();
+ }
+ 
+ /**
+  * @brief Set the kernel of the filter from a std::array.
+  * 
+  * @tparam n The length of the kernel.
+  * @param taps The kernel.
+  */
+ template <unsigned long n>
+ void setKernel(const std::array<SampleType, n> &taps)
+ { setKernel(taps.data(), static_cast<int>(n)); }
+ 
+ /**
+  * @brief Set the kernel of the filter from a std::vector.
+  * 
+  * @param taps The kernel.
+  */
+ void setKernel(const std::vector<SampleType> &taps)
+ { setKernel(taps.data(), static_cast<int>(taps.size())); }
+ 
+ /**
+  * @brief Generate the kernel of the filter from one of the impulses in XDDSP_FIRImpulses.h.
+  * 
+  * @tparam Impulse The class of the impulse, which is implied from the impulse parameter.
+  * @param impulse An instance of one of the impulse classes.
+  * @param tapCount The length of the kernel, which should be the length the impulse was constructed with.
+  */
+ template <typename Impulse>
+ void generateKernel(Impulse impulse, int tapCount)
+ {
+  std::array<SampleType, MaxTaps> taps;
+  tapCount = std::max(1, std::min(MaxTaps, tapCount));
+  generateImpulseResponse(impulse, taps.data(), tapCount);
+  setKernel(taps.data(), tapCount);
+ }
+ 
+ /**
+  * @brief Generate the kernel of the filter from one of the impulses in XDDSP_FIRImpulses.h and apply a window function to it.
+  * 
+  * @tparam Impulse The class of the impulse, which is implied from the impulse parameter.
+  * @tparam WindowType The class of window function, which is implied from the window parameter.
+  * @param impulse An instance of one of the impulse classes.
+  * @param window An instance of one of the window functions in XDDSP_WindowFunctions.h. Windows span from 0 to their length inclusive, so construct the window with a length one less than the tap count to keep a linear phase kernel symmetric.
+  * @param tapCount The length of the kernel, which should be the length the impulse was constructed with.
+  */
+ template <typename Impulse, typename WindowType>
+ void generateKernel(Impulse impulse, WindowType window, int tapCount)
+ {
+  std::array<SampleType, MaxTaps> taps;
+  tapCount = std::max(1, std::min(MaxTaps, tapCount));
+  generateImpulseResponse(impulse, taps.data(), tapCount);
+  applyWindowFunction(window, taps.data(), tapCount);
+  setKernel(taps.data(), tapCount);
+ }
+ 
+ /**
+  * @brief Get the length of the current kernel.
+  * 
+  * @return int The number of taps.
+  */
+ int getTapCount() const
+ { return length; }
+ 
+ /**
+  * @brief Get the type of the current kernel.
+  * 
+  * @return int One of the values in FIRKernelType.
+  */
+ int getKernelType() const
+ { return type; }
+ 
+ /**
+  * @brief Get the delay of the filter, which is exact for linear phase kernels.
+  * 
+  * @return SampleType The delay in samples.
+  */
+ SampleType getGroupDelay() const
+ { return 0.5*(length - 1); }
+ 
+ void reset()
+ {
+  for (auto &h : history) h.fill(0.);
+  for (auto &h : reversedHistory) h.fill(0.);
+  position = 0;
+  signalOut.reset();
+ }
+ 
+ void stepProcess(int startPoint, int sampleCount)
+ {
+  const SampleType *k = kernel.data();
+  const int half = length/2;
+  const bool odd = (length % 2) == 1;
+  
+  // The first of the non-zero taps of a half-band kernel, which are every other tap counting back from the centre
+  const int firstOddTap = half & 1 ? 0 : 1;
+  int p = position;
+  
+  for (int c = 0; c < Count; ++c)
+  {
+   SampleType *h = history[c].data();
+   SampleType *r = reversedHistory[c].data();
+   p = position;
+   for (int i = startPoint, s = sampleCount; s--; ++i)
+   {
+    const SampleType in = signalIn(c, i);
+    h[p] = h[p + length] = in;
+    r[length - 1 - p] = r[2*length - 1 - p] = in;
+    
+    // The last samples of the input, newest first
+    const SampleType *xr = r + length - 1 - p;
+    p = (p + 1 == length) ? 0 : p + 1;
+    
+    // The last samples of the input, oldest first
+    const SampleType *x = h + p;
+    SampleType y;
+    switch (type)
+    {
+     case FIRKernelType::Symmetric:
+      y = sumTerms(half, [=](int t) { return k[t]*(x[t] + xr[t]); });
+      if (odd) y += k[half]*x[half];
+      break;
+      
+     case FIRKernelType::Antisymmetric:
+      y = sumTerms(half, [=](int t) { return k[t]*(x[t] - xr[t]); });
+      break;
+      
+     case FIRKernelType::HalfBand:
+      {
+       const SampleType *kh = k + firstOddTap;
+       const SampleType *xh = x + firstOddTap;
+       const SampleType *xrh = xr + firstOddTap;
+       y = sumTerms((half + 1)/2, [=](int j) { return kh[2*j]*(xh[2*j] + xrh[2*j]); });
+      }
+      y += k[half]*x[half];
+      break;
+      
+     default:
+      y = sumTerms(length, [=](int t) { return k[t]*x[t]; });
+      break;
+    }
+    signalOut.buffer(c, i) = y;
+   }
+  }
+  position = p;
+ }
+};
+
+
+
+
+
+
+
+
+
+
+
 /**
  * @brief A component encapsulating a Hilbert Transform using a convolution kernel.
  * 
@@ -433,7 +1157,7 @@ public:
  * @tparam FIRTapCount Controls the size of the convolution kernel used. **The tap count must be an odd number**. The default is 255.
  */
 template <typename SignalIn, int FIRTapCount = 255>
-class ConvolutionHilbertFilter : public Component<ConvolutionHilbertFilter<SignalIn>>
+class ConvolutionHilbertFilter : public Component<ConvolutionHilbertFilter<SignalIn, FIRTapCount>>
 {
  static_assert(FIRTapCount % 2 == 1, "FIRHilbertTransform: Tap Count must be odd");
  
@@ -444,6 +1168,7 @@ class ConvolutionHilbertFilter : public Component<ConvolutionHilbertFilter<Signa
  // Private data members here
  std::array<SampleType, FIRTapCount> taps;
  static constexpr SampleType alpha = 25.0/46.0;
+ static constexpr int BlockSize = 64;
 public:
  static constexpr int DelayLength = FIRTapCount/2;
  static constexpr int Count = SignalIn::Count;
@@ -461,7 +1186,7 @@ public:
  {
   for (auto &b: buffer)
   {
-   b.setMaximumLength(FIRTapCount);
+   b.setMaximumLength(DelayLength + BlockSize);
    b.reset(0.);
   }
 
@@ -488,12 +1213,17 @@ public:
  {
   filter.process(startPoint, sampleCount);
   
+  alignas(32) std::array<SampleType, BlockSize> x;
   for (int c = 0; c < Count; ++c)
   {
-   for (int i = startPoint, s = sampleCount; s--; ++i)
+   for (int i = startPoint, s = sampleCount; s > 0;)
    {
-    buffer[c].tapIn(signalIn(c, i));
-    inPhaseOut.buffer(c, i) = buffer[c].tapOut(DelayLength);
+    const int n = std::min(s, BlockSize);
+    for (int j = 0; j < n; ++j) x[j] = signalIn(c, i + j);
+    buffer[c].write(x.data(), n);
+    buffer[c].read(DelayLength, inPhaseOut.buffer[c] + i, n);
+    i += n;
+    s -= n;
    }
   }
  }
@@ -519,8 +1249,11 @@ public:
 template <typename SignalIn>
 class IIRHilbertApproximator : public Component<IIRHilbertApproximator<SignalIn>>
 {
- // Private data members here
- std::array<std::array<SampleType, 33>, SignalIn::Count> h;
+ static constexpr int Lanes = (SignalIn::Count == 1) ? 1 : multichannelKernelLanes(SignalIn::Count);
+ static constexpr int BlockSize = 32;
+ 
+ // Both all pass chains of every channel are processed together
+ IIRHilbertKernel<Lanes> flt;
  
 public:
  static constexpr int Count = SignalIn::Count;
@@ -534,60 +1267,185 @@ public:
  signalIn(_signalIn),
  quadratureOut(p),
  inPhaseOut(p)
- {
-  for (auto &hx : h) hx.fill(0.);
- }
+ {}
  
  void reset()
  {
   quadratureOut.reset();
   inPhaseOut.reset();
-  for (auto &hx : h) hx.fill(0.);
+  flt.reset();
  }
  
  void stepProcess(int startPoint, int sampleCount)
  {
-  SampleType xa, xb;
-  for (int c = 0; c < Count; ++c)
+  alignas(32) std::array<SampleType, BlockSize*Lanes> x {};
+  alignas(32) std::array<SampleType, BlockSize*Lanes> inPhase;
+  alignas(32) std::array<SampleType, BlockSize*Lanes> quadrature;
+  
+  // The channels are interleaved into short blocks for the kernel
+  for (int i = startPoint, s = sampleCount; s > 0;)
   {
-   for (int i = startPoint, s = sampleCount; s--; ++i)
+   const int n = std::min(s, BlockSize);
+   for (int j = 0; j < n; ++j)
+   {
+    for (int c = 0; c < Count; ++c) x[j*Lanes + c] = signalIn(c, i + j);
+   }
+   
+   flt.process(x.data(), inPhase.data(), quadrature.data(), n);
+   
+   for (int c = 0; c < Count; ++c)
+   {
+    for (int j = 0; j < n; ++j)
+    {
+     inPhaseOut.buffer(c, i + j) = inPhase[j*Lanes + c];
+     quadratureOut.buffer(c, i + j) = quadrature[j*Lanes + c];
+    }
+   }
+   
+   i += n;
+   s -= n;
+  }
+ }
+};
+
+
+
+
+
+
+
+
+
+
+/**
+ * @brief A component which shifts every frequency in a signal by the same number of Hz, using single sideband modulation.
+ * 
+ * The signal is split into in phase and quadrature parts with an IIRHilbertKernel, which are then mixed with a quadrature oscillator. Unlike ring modulation, only one sideband is produced, so harmonic sounds become inharmonic as the shift increases. The oscillator is a rotating phasor, so no trigonometric functions are calculated for each sample.
+ * 
+ * @tparam SignalIn Couples to the input signal. Can have as many channels as you like.
+ * @tparam ShiftIn Couples to the amount of shift in Hz, which can be negative to shift frequencies down. Must either have one channel or the same number of channels as SignalIn.
+ */
+template <typename SignalIn, typename ShiftIn>
+class FrequencyShifter : public Component<FrequencyShifter<SignalIn, ShiftIn>>
+{
+ static_assert(ShiftIn::Count == 1 || ShiftIn::Count == SignalIn::Count, "FrequencyShifter: ShiftIn must either have one channel or the same number of channels as SignalIn");
+ 
+ static constexpr int Lanes = (SignalIn::Count == 1) ? 1 : multichannelKernelLanes(SignalIn::Count);
+ static constexpr bool MultiShift = (ShiftIn::Count == SignalIn::Count);
+ static constexpr int BlockSize = 32;
+ 
+ Parameters &dspParam;
+ IIRHilbertKernel<Lanes> flt;
+ 
+ // The quadrature oscillator, as a phasor of unit length
+ alignas(32) std::array<SampleType, Lanes> cosPhase;
+ alignas(32) std::array<SampleType, Lanes> sinPhase;
+ 
+public:
+ static constexpr int Count = SignalIn::Count;
+ 
+ SignalIn signalIn;
+ ShiftIn shiftIn;
+ 
+ /**
+  * @brief The signal shifted by the amount at shiftIn.
+  * 
+  */
+ Output<Count> signalOut;
+ 
+ /**
+  * @brief The signal shifted in the opposite direction, by the negative of the amount at shiftIn.
+  * 
+  */
+ Output<Count> mirrorOut;
+ 
+ FrequencyShifter(Parameters &p, SignalIn signalIn, ShiftIn shiftIn) :
+ dspParam(p),
+ signalIn(signalIn),
+ shiftIn(shiftIn),
+ signalOut(p),
+ mirrorOut(p)
+ {
+  reset();
+ }
+ 
+ void reset()
+ {
+  signalOut.reset();
+  mirrorOut.reset();
+  flt.reset();
+  cosPhase.fill(1.);
+  sinPhase.fill(0.);
+ }
+ 
+ void stepProcess(int startPoint, int sampleCount)
+ {
+  const SampleType isr = dspParam.sampleInterval();
+  alignas(32) std::array<SampleType, BlockSize*Lanes> x {};
+  alignas(32) std::array<SampleType, BlockSize*Lanes> inPhase;
+  alignas(32) std::array<SampleType, BlockSize*Lanes> quadrature;
+  alignas(32) std::array<SampleType, Lanes> cosStep;
+  alignas(32) std::array<SampleType, Lanes> sinStep {};
+  cosStep.fill(1.);
+  
+  // The channels are interleaved into short blocks for the kernel
+  for (int i = startPoint, s = sampleCount; s > 0;)
+  {
+   const int n = std::min(s, BlockSize);
+   for (int j = 0; j < n; ++j)
+   {
+    for (int c = 0; c < Count; ++c) x[j*Lanes + c] = signalIn(c, i + j);
+   }
+   
+   flt.process(x.data(), inPhase.data(), quadrature.data(), n);
+   
+   for (int j = 0; j < n; ++j)
    {
-    xa = h[c][1] - 0.999533593f*signalIn(c, i);  h[c][1] = h[c][0];
-    h[c][0] = signalIn(c, i) + 0.999533593f*xa;
-    xb = h[c][3] - 0.997023120f*xa;  h[c][3] = h[c][2];
-    h[c][2] = xa + 0.997023120f*xb;
-    xa = h[c][5] - 0.991184054f*xb;  h[c][5] = h[c][4];
-    h[c][4] = xb + 0.991184054f*xa;
-    xb = h[c][7] - 0.975597057f*xa;  h[c][7] = h[c][6];
-    h[c][6] = xa + 0.975597057f*xb;
-    xa = h[c][9] - 0.933889435f*xb;  h[c][9] = h[c][8];
-    h[c][8] = xb + 0.933889435f*xa;
-    xb = h[c][11] - 0.827559364f*xa;  h[c][11] = h[c][10];
-    h[c][10] = xa + 0.827559364f*xb;
-    xa = h[c][13] - 0.590957946f*xb;  h[c][13] = h[c][12];
-    h[c][12] = xb + 0.590957946f*xa;
-    xb = h[c][15] - 0.219852059f*xa;  h[c][15] = h[c][14];
-    h[c][14] = xa + 0.219852059f*xb;
-    quadratureOut.buffer(c, i) = h[c][32]; h[c][32] = xb;
-
-    // out2 filter chain: 8 allpasses
-    xa = h[c][17] - 0.998478404f*signalIn(c, i);  h[c][17] = h[c][16];
-    h[c][16] = signalIn(c, i) + 0.998478404f*xa;
-    xb = h[c][19] - 0.994786059f*xa;  h[c][19] = h[c][18];
-    h[c][18] = xa + 0.994786059f*xb;
-    xa = h[c][21] - 0.985287169f*xb;  h[c][21] = h[c][20];
-    h[c][20] = xb + 0.985287169f*xa;
-    xb = h[c][23] - 0.959716311f*xa;  h[c][23] = h[c][22];
-    h[c][22] = xa + 0.959716311f*xb;
-    xa = h[c][25] - 0.892466594f*xb;  h[c][25] = h[c][24];
-    h[c][24] = xb + 0.892466594f*xa;
-    xb = h[c][27] - 0.729672406f*xa;  h[c][27] = h[c][26];
-    h[c][26] = xa + 0.729672406f*xb;
-    xa = h[c][29] - 0.413200818f*xb;  h[c][29] = h[c][28];
-    h[c][28] = xb + 0.413200818f*xa;
-    inPhaseOut.buffer(c, i) = h[c][31] - 0.061990080f*xa; h[c][31] = h[c][30];
-    h[c][30] = xa + 0.061990080f*inPhaseOut.buffer(c, i);
+    for (int c = 0; c < Count; ++c)
+    {
+     if (MultiShift || c == 0)
+     {
+      // The rotation for one sample, from the tangent of half the angle
+      const SampleType half = fastBoundary(shiftIn(MultiShift ? c : 0, i + j)*isr, -0.49, 0.49)*M_PI;
+      const SampleType t = std::copysign(static_cast<SampleType>(fastTan(std::fabs(half))), half);
+      const SampleType norm = 1./(1. + t*t);
+      cosStep[c] = (1. - t*t)*norm;
+      sinStep[c] = 2.*t*norm;
+     }
+     else
+     {
+      cosStep[c] = cosStep[0];
+      sinStep[c] = sinStep[0];
+     }
+    }
+    
+    for (int l = 0; l < Lanes; ++l)
+    {
+     const SampleType a = inPhase[j*Lanes + l]*cosPhase[l];
+     const SampleType b = quadrature[j*Lanes + l]*sinPhase[l];
+     inPhase[j*Lanes + l] = a - b;
+     quadrature[j*Lanes + l] = a + b;
+     
+     // Rotate the phasor, and pull its length back towards 1 to stop rounding errors from building up
+     const SampleType cp = cosPhase[l]*cosStep[l] - sinPhase[l]*sinStep[l];
+     const SampleType sp = sinPhase[l]*cosStep[l] + cosPhase[l]*sinStep[l];
+     const SampleType g = 1.5 - 0.5*(cp*cp + sp*sp);
+     cosPhase[l] = cp*g;
+     sinPhase[l] = sp*g;
+    }
+   }
+   
+   for (int c = 0; c < Count; ++c)
+   {
+    for (int j = 0; j < n; ++j)
+    {
+     signalOut.buffer(c, i + j) = inPhase[j*Lanes + c];
+     mirrorOut.buffer(c, i + j) = quadrature[j*Lanes + c];
+    }
    }
+   
+   i += n;
+   s -= n;
   }
  }
 };
@@ -0,0 +1,406 @@
+//
+//  XDDSP_FrequencyResponse.h
+//  XDDSP
+//
+
+#ifndef XDDSP_FrequencyResponse_h
+#define XDDSP_FrequencyResponse_h
+
+#include "XDDSP_Functions.h"
+#include "XDDSP_Parameters.h"
+#include "XDDSP_BiquadKernel.h"
+#include "XDDSP_LinkwitzRileyKernel.h"
+#include <complex>
+#include <vector>
+
+
+
+
+
+
+
+
+
+
+namespace XDDSP
+{
+
+
+
+
+
+
+
+
+
+
+/**
+ * @brief A class which calculates the frequency responses of many filters over a shared grid of frequencies, intended for drawing filter curves such as EQ displays.
+ * 
+ * The grid holds tables of exp(-jkw) for every frequency, so no complex exponentials are calculated after the grid is set. Filters are added by reference and evaluated in plain loops over the tables which the compiler can vectorise. Each call to update compares the coefficients of every filter with the coefficients used last time and recalculates only the filters which have changed, then the combined response of all of the filters.
+ * 
+ * The filters added to the grid must outlive it, or be removed by calling clearFilters. The responses should be updated from the same thread which configures the filters.
+ */
+class FrequencyResponseGrid : public Parameters::ParameterListener
+{
+ // The highest power of z^-1 in any supported filter
+ static constexpr int MaxOrder = 4;
+ 
+ // The coefficients of one section, in the order b0 to b4 then a1 to a4, and then 1 if the response is squared
+ typedef std::array<double, 2*MaxOrder + 2> SectionCoefficients;
+ 
+ struct Section
+ {
+  BiquadFilterCoefficients *biquad;
+  LinkwitzRileyFilterCoefficients *crossover;
+  bool highPass;
+  SectionCoefficients used;
+ };
+ 
+ struct Filter
+ {
+  std::vector<Section> sections;
+  std::vector<double> re;
+  std::vector<double> im;
+ };
+ 
+ Parameters &dspParam;
+ 
+ std::vector<SampleType> frequencies;
+ std::array<std::vector<double>, MaxOrder> cosTable;
+ std::array<std::vector<double>, MaxOrder> sinTable;
+ 
+ std::vector<Filter> filters;
+ std::vector<double> totalRe;
+ std::vector<double> totalIm;
+ bool dirty {true};
+ 
+ static SectionCoefficients currentCoefficients(const Section &s)
+ {
+  SectionCoefficients result {};
+  if (s.biquad)
+  {
+   const std::array<double, 5> c = s.biquad->getCoefficients();
+   result[0] = c[0];
+   result[1] = c[1];
+   result[2] = c[2];
+   result[5] = c[3];
+   result[6] = c[4];
+   result[9] = s.biquad->isCascade() ? 1. : 0.;
+  }
+  else
+  {
+   const std::array<double, 9> c = s.crossover->getCoefficients(s.highPass);
+   for (int k = 0; k < 9; ++k) result[k] = c[k];
+  }
+  return result;
+ }
+ 
+ void buildTables()
+ {
+  const int n = static_cast<int>(frequencies.size());
+  for (int k = 0; k < MaxOrder; ++k)
+  {
+   cosTable[k].resize(n);
+   sinTable[k].resize(n);
+  }
+  
+  for (int i = 0; i < n; ++i)
+  {
+   const double w = 2.*M_PI*frequencies[i]*dspParam.sampleInterval();
+   const double c = cos(w);
+   const double s = sin(w);
+   cosTable[0][i] = c;
+   sinTable[0][i] = s;
+   
+   // Higher powers by rotation, which stays accurate for the few powers needed
+   for (int k = 1; k < MaxOrder; ++k)
+   {
+    cosTable[k][i] = cosTable[k - 1][i]*c - sinTable[k - 1][i]*s;
+    sinTable[k][i] = sinTable[k - 1][i]*c + cosTable[k - 1][i]*s;
+   }
+  }
+  
+  totalRe.resize(n);
+  totalIm.resize(n);
+  for (auto &f : filters)
+  {
+   f.re.resize(n);
+   f.im.resize(n);
+  }
+  dirty = true;
+ }
+ 
+ // Multiply the response of one section into the arrays
+ void applySection(const SectionCoefficients &c, double *re, double *im)
+ {
+  const int n = static_cast<int>(frequencies.size());
+  const double *c1 = cosTable[0].data(), *c2 = cosTable[1].data(), *c3 = cosTable[2].data(), *c4 = cosTable[3].data();
+  const double *s1 = sinTable[0].data(), *s2 = sinTable[1].data(), *s3 = sinTable[2].data(), *s4 = sinTable[3].data();
+  const bool squared = c[9] != 0.;
+  
+  for (int i = 0; i < n; ++i)
+  {
+   // exp(-jkw) = cos(kw) - j sin(kw)
+   const double nr = c[0] + c[1]*c1[i] + c[2]*c2[i] + c[3]*c3[i] + c[4]*c4[i];
+   const double ni = -(c[1]*s1[i] + c[2]*s2[i] + c[3]*s3[i] + c[4]*s4[i]);
+   const double dr = 1. + c[5]*c1[i] + c[6]*c2[i] + c[7]*c3[i] + c[8]*c4[i];
+   const double di = -(c[5]*s1[i] + c[6]*s2[i] + c[7]*s3[i] + c[8]*s4[i]);
+   
+   const double norm = 1./(dr*dr + di*di);
+   double hr = (nr*dr + ni*di)*norm;
+   double hi = (ni*dr - nr*di)*norm;
+   if (squared)
+   {
+    const double t = hr*hr - hi*hi;
+    hi = 2.*hr*hi;
+    hr = t;
+   }
+   
+   const double r = re[i]*hr - im[i]*hi;
+   im[i] = re[i]*hi + im[i]*hr;
+   re[i] = r;
+  }
+ }
+ 
+ int addSections(const std::vector<Section> &sections)
+ {
+  Filter f;
+  f.sections = sections;
+  f.re.resize(frequencies.size());
+  f.im.resize(frequencies.size());
+  filters.push_back(std::move(f));
+  dirty = true;
+  return static_cast<int>(filters.size()) - 1;
+ }
+ 
+public:
+ FrequencyResponseGrid(Parameters &p) :
+ Parameters::ParameterListener(p),
+ dspParam(p)
+ {}
+ 
+ virtual void updateSampleRate(double sr, double isr) override
+ {
+  buildTables();
+ }
+ 
+ /**
+  * @brief Set the frequencies of the grid.
+  * 
+  * @param hz An array of frequencies in Hz.
+  * @param count The number of frequencies in the array.
+  */
+ void setFrequencies(const SampleType *hz, int count)
+ {
+  frequencies.assign(hz, hz + count);
+  buildTables();
+ }
+ 
+ /**
+  * @brief Set the grid to frequencies spaced evenly in pitch, as used by most EQ displays.
+  * 
+  * @param lowHz The lowest frequency in Hz.
+  * @param highHz The highest frequency in Hz.
+  * @param count The number of frequencies in the grid.
+  */
+ void setLogarithmicFrequencies(SampleType lowHz, SampleType highHz, int count)
+ {
+  frequencies.resize(count);
+  const double ratio = (count > 1) ? log(highHz/lowHz)/(count - 1) : 0.;
+  for (int i = 0; i < count; ++i) frequencies[i] = lowHz*exp(ratio*i);
+  buildTables();
+ }
+ 
+ /**
+  * @brief Get the number of frequencies in the grid.
+  * 
+  * @return int The number of frequencies.
+  */
+ int size()
+ { return static_cast<int>(frequencies.size()); }
+ 
+ /**
+  * @brief Get one of the frequencies in the grid.
+  * 
+  * @param point The index of the frequency.
+  * @return SampleType The frequency in Hz.
+  */
+ SampleType getFrequencyHz(int point)
+ { return frequencies[point]; }
+ 
+ /**
+  * @brief Add a biquad filter to the grid.
+  * 
+  * @param coeff The coefficients object of the filter.
+  * @return int The index of the filter, used to get its individual response.
+  */
+ int addFilter(BiquadFilterCoefficients &coeff)
+ {
+  return addSections({Section{&coeff, nullptr, false, {}}});
+ }
+ 
+ /**
+  * @brief Add a cascade of biquad filters to the grid as one filter, such as the coefficients of a BiquadCascade.
+  * 
+  * @param coeff The coefficients objects of the stages.
+  * @return int The index of the filter, used to get its individual response.
+  */
+ template <std::size_t Stages>
+ int addFilter(std::array<BiquadFilterCoefficients, Stages> &coeff)
+ {
+  std::vector<Section> sections;
+  for (auto &c : coeff) sections.push_back(Section{&c, nullptr, false, {}});
+  return addSections(sections);
+ }
+ 
+ /**
+  * @brief Add one output of a Linkwitz-Riley filter to the grid.
+  * 
+  * @param coeff The coefficients object of the filter.
+  * @param highPass Set as true for the high pass output, or false for the low pass output.
+  * @return int The index of the filter, used to get its individual response.
+  */
+ int addFilter(LinkwitzRileyFilterCoefficients &coeff, bool highPass)
+ {
+  return addSections({Section{nullptr, &coeff, highPass, {}}});
+ }
+ 
+ /**
+  * @brief Remove all of the filters from the grid.
+  * 
+  */
+ void clearFilters()
+ {
+  filters.clear();
+  dirty = true;
+ }
+ 
+ /**
+  * @brief Recalculate the responses of the filters which have changed since the last update, and the combined response of all of the filters.
+  * 
+  * @return true If any response changed.
+  * @return false If nothing changed and the responses were left alone.
+  */
+ bool update()
+ {
+  const int n = size();
+  bool changed = dirty;
+  
+  for (auto &f : filters)
+  {
+   bool filterChanged = dirty;
+   for (auto &s : f.sections)
+   {
+    const SectionCoefficients c = currentCoefficients(s);
+    if (c != s.used)
+    {
+     s.used = c;
+     filterChanged = true;
+    }
+   }
+   
+   if (filterChanged)
+   {
+    std::fill(f.re.begin(), f.re.end(), 1.);
+    std::fill(f.im.begin(), f.im.end(), 0.);
+    for (auto &s : f.sections) applySection(s.used, f.re.data(), f.im.data());
+    changed = true;
+   }
+  }
+  
+  if (changed)
+  {
+   std::fill(totalRe.begin(), totalRe.end(), 1.);
+   std::fill(totalIm.begin(), totalIm.end(), 0.);
+   for (auto &f : filters)
+   {
+    for (int i = 0; i < n; ++i)
+    {
+     const double r = totalRe[i]*f.re[i] - totalIm[i]*f.im[i];
+     totalIm[i] = totalRe[i]*f.im[i] + totalIm[i]*f.re[i];
+     totalRe[i] = r;
+    }
+   }
+  }
+  
+  dirty = false;
+  return changed;
+ }
+ 
+ /**
+  * @brief Get the combined response of all of the filters at one point of the grid, as of the last update.
+  * 
+  * @param point The index of the frequency.
+  * @return std::complex<double> A complex number representing the amplitude and phase response of the filters.
+  */
+ std::complex<double> getResponse(int point)
+ { return {totalRe[point], totalIm[point]}; }
+ 
+ /**
+  * @brief Get the response of one filter at one point of the grid, as of the last update.
+  * 
+  * @param filter The index of the filter, as returned by addFilter.
+  * @param point The index of the frequency.
+  * @return std::complex<double> A complex number representing the amplitude and phase response of the filter.
+  */
+ std::complex<double> getResponse(int filter, int point)
+ { return {filters[filter].re[point], filters[filter].im[point]}; }
+ 
+ /**
+  * @brief Copy the combined magnitude response of all of the filters over the whole grid, as of the last update.
+  * 
+  * @param dest An array with room for one value for every point of the grid, which receives the responses as multipliers (use linear2dB to convert to decibels).
+  */
+ void getMagnitudeResponse(SampleType *dest)
+ {
+  for (int i = 0, n = size(); i < n; ++i) dest[i] = sqrt(totalRe[i]*totalRe[i] + totalIm[i]*totalIm[i]);
+ }
+ 
+ /**
+  * @brief Copy the magnitude response of one filter over the whole grid, as of the last update.
+  * 
+  * @param filter The index of the filter, as returned by addFilter.
+  * @param dest An array with room for one value for every point of the grid, which receives the responses as multipliers (use linear2dB to convert to decibels).
+  */
+ void getMagnitudeResponse(int filter, SampleType *dest)
+ {
+  const Filter &f = filters[filter];
+  for (int i = 0, n = size(); i < n; ++i) dest[i] = sqrt(f.re[i]*f.re[i] + f.im[i]*f.im[i]);
+ }
+ 
+ /**
+  * @brief Copy the combined phase response of all of the filters over the whole grid, as of the last update.
+  * 
+  * @param dest An array with room for one value for every point of the grid, which receives the phase responses in radians.
+  */
+ void getPhaseResponse(SampleType *dest)
+ {
+  for (int i = 0, n = size(); i < n; ++i) dest[i] = atan2(totalIm[i], totalRe[i]);
+ }
+ 
+ /**
+  * @brief Copy the phase response of one filter over the whole grid, as of the last update.
+  * 
+  * @param filter The index of the filter, as returned by addFilter.
+  * @param dest An array with room for one value for every point of the grid, which receives the phase responses in radians.
+  */
+ void getPhaseResponse(int filter, SampleType *dest)
+ {
+  const Filter &f = filters[filter];
+  for (int i = 0, n = size(); i < n; ++i) dest[i] = atan2(f.im[i], f.re[i]);
+ }
+};
+
+
+
+
+
+
+
+
+
+
+}
+
+#endif /* XDDSP_FrequencyResponse_h */
@@ -8,6 +8,7 @@
 #ifndef XDDSP_Functions_h
 #define XDDSP_Functions_h
 
+#include <cstring>
 #include "XDDSP_Types.h"
 
 
@@ -157,6 +158,59 @@ inline SampleType dB2Linear(SampleType dB)
  return exp(dB * 0.115129254649702);
 }
 
+/**
+ * @brief Calculate the tangent of an angle between 0 and pi/2 quickly, such as for prewarping filter frequencies.
+ * 
+ * A rational approximation is used, with a relative error below 2e-8 across the whole range.
+ * 
+ * @param x The angle in radians, between 0 and pi/2.
+ * @return double The tangent of the angle.
+ */
+inline double fastTan(double x)
+{
+ auto pade = [](double y)
+ {
+  const double y2 = y*y;
+  return y*(945. - 105.*y2 + y2*y2)/(945. - 420.*y2 + 15.*y2*y2);
+ };
+ 
+ // Above pi/4, use the reciprocal of the tangent of the complementary angle
+ if (x <= 0.25*M_PI) return pade(x);
+ return 1./pade(0.5*M_PI - x);
+}
+
+/**
+ * @brief Raise 2 to a power quickly.
+ * 
+ * A polynomial is used for the fractional part of the power, with a relative error below 2e-7. Powers are limited to the range of a double.
+ * 
+ * @param x The power.
+ * @return double Two raised to the power.
+ */
+inline double fastExp2(double x)
+{
+ x = std::max(-1022., std::min(1023., x));
+ const double n = std::nearbyint(x);
+ const double f = (x - n)*0.6931471805599453;
+ const double p = 1. + f*(1. + f*(1./2. + f*(1./6. + f*(1./24. + f*(1./120. + f*(1./720.))))));
+ 
+ const uint64_t bits = static_cast<uint64_t>(static_cast<int64_t>(n) + 1023) << 52;
+ double scale;
+ std::memcpy(&scale, &bits, sizeof(scale));
+ return p*scale;
+}
+
+/**
+ * @brief Convert a dB sample (measurement, gain etc.) to a linear sample quickly, with a relative error below 2e-7.
+ * 
+ * @param dB The sample in decibels to convert.
+ * @return SampleType The converted sample.
+ */
+inline SampleType fastdB2Linear(SampleType dB)
+{
+ return fastExp2(dB * 0.166096404744368);
+}
+
 /**
  * @brief Perform a linear interpolation between two samples.
  * 
@@ -316,6 +370,128 @@ inline int lowestBitSet(uint32_t word)
  return BitPositionLookup[((uint32_t)((word & -word) * 0x077CB531U)) >> 27];
 }
 
+/**
+ * @brief Convert a float to an IEEE 754 half precision float, rounding to the nearest value.
+ * 
+ * Values too large for half precision become infinity, and NaN stays NaN. The result for every range is calculated and the right one is chosen with masks instead of branches, so loops of conversions can be vectorised and take the same time whatever the values are.
+ * 
+ * @param f The float to convert.
+ * @return uint16_t The bits of the half precision float.
+ */
+inline uint16_t floatToHalf(float f)
+{
+ uint32_t bits;
+ std::memcpy(&bits, &f, sizeof(bits));
+ const uint32_t sign = (bits >> 16) & 0x8000;
+ bits &= 0x7fffffff;
+ 
+ // Rebias the exponent and round the mantissa to nearest even
+ const uint32_t normal = (bits + 0xc8000fff + ((bits >> 13) & 1)) >> 13;
+ 
+ // Too small for a normal half, so let a float addition do the rounding to a subnormal
+ float a;
+ std::memcpy(&a, &bits, sizeof(a));
+ a += 0.5f;
+ uint32_t subnormal;
+ std::memcpy(&subnormal, &a, sizeof(subnormal));
+ subnormal -= 0x3f000000;
+ 
+ // Infinity, or NaN with the quiet bit set, for values too large to represent
+ const uint32_t special = 0x7c00 | (static_cast<uint32_t>(bits > 0x7f800000) << 9);
+ 
+ const uint32_t small = 0u - static_cast<uint32_t>(bits < 0x38800000);
+ const uint32_t large = 0u - static_cast<uint32_t>(bits >= 0x47800000);
+ uint32_t h = (subnormal & small) | (normal & ~small);
+ h = (special & large) | (h & ~large);
+ return static_cast<uint16_t>(sign | h);
+}
+
+/**
+ * @brief Convert an IEEE 754 half precision float to a float.
+ * 
+ * Infinity and NaN are not preserved, so this is only suitable for finite values. No arithmetic is done on denormal floats, so subnormal halves are converted correctly and quickly even when denormals are flushed to zero.
+ * 
+ * @param h The bits of the half precision float.
+ * @return float The value of the half precision float.
+ */
+inline float halfToFloat(uint16_t h)
+{
+ const uint32_t magnitude = h & 0x7fff;
+ 
+ // A normal half only needs its exponent and mantissa moved into place and the exponent bias corrected
+ const uint32_t normal = (magnitude << 13) + 0x38000000;
+ 
+ // A subnormal half is its mantissa times 2^-24, which is always a normal float
+ const float s = static_cast<float>(magnitude)*0x1p-24f;
+ uint32_t subnormal;
+ std::memcpy(&subnormal, &s, sizeof(subnormal));
+ 
+ const uint32_t small = 0u - static_cast<uint32_t>(magnitude < 0x400);
+ const uint32_t bits = (subnormal & small) | (normal & ~small) | (static_cast<uint32_t>(h & 0x8000) << 16);
+ float f;
+ std::memcpy(&f, &bits, sizeof(f));
+ return f;
+}
+
+/**
+ * @brief Convert a float to a bfloat16, rounding to the nearest value.
+ * 
+ * A bfloat16 keeps the range of a float but only 8 bits of precision.
+ * 
+ * @param f The float to convert.
+ * @return uint16_t The bits of the bfloat16.
+ */
+inline uint16_t floatToBFloat16(float f)
+{
+ uint32_t bits;
+ std::memcpy(&bits, &f, sizeof(bits));
+ if ((bits & 0x7fffffff) > 0x7f800000) return static_cast<uint16_t>((bits >> 16) | 0x40);
+ bits += 0x7fff + ((bits >> 16) & 1);
+ return static_cast<uint16_t>(bits >> 16);
+}
+
+/**
+ * @brief Convert a bfloat16 to a float.
+ * 
+ * @param b The bits of the bfloat16.
+ * @return float The value of the bfloat16.
+ */
+inline float bfloat16ToFloat(uint16_t b)
+{
+ const uint32_t bits = static_cast<uint32_t>(b) << 16;
+ float f;
+ std::memcpy(&f, &bits, sizeof(f));
+ return f;
+}
+
+/**
+ * @brief Add up a number of terms using several partial sums, which are only added together at the end.
+ * 
+ * The compiler may not reorder a single running sum of floating point values, so a dot product written that way can not be vectorised. Spreading the terms over sixteen partial sums lets the compiler keep them in vector registers. The result can differ from a running sum by rounding.
+ * 
+ * @tparam Term A callable type which takes the index of a term and returns its value.
+ * @param count The number of terms.
+ * @param term The callable object which calculates each term.
+ * @return SampleType The sum of the terms.
+ */
+template <typename Term>
+inline SampleType sumTerms(int count, Term term)
+{
+ constexpr int Lanes = 16;
+ std::array<SampleType, Lanes> partial;
+ partial.fill(0.);
+ int i = 0;
+ for (; i + Lanes <= count; i += Lanes)
+ {
+  for (int l = 0; l < Lanes; ++l) partial[l] += term(i + l);
+ }
+ 
+ SampleType sum = 0.;
+ for (; i < count; ++i) sum += term(i);
+ for (int l = 0; l < Lanes; ++l) sum += partial[l];
+ return sum;
+}
+
 
 
 
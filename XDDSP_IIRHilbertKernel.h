@@ -0,0 +1,150 @@
+//
+//  XDDSP_IIRHilbertKernel.h
+//  XDDSP
+//
+
+#ifndef XDDSP_IIRHilbertKernel_h
+#define XDDSP_IIRHilbertKernel_h
+
+#include "XDDSP_Types.h"
+
+
+
+
+
+
+
+
+
+
+namespace XDDSP
+{
+
+
+
+
+
+
+
+
+
+
+/**
+ * @brief A kernel which approximates the Hilbert transform with two chains of eight all pass filters, whose outputs are close to 90 degrees apart across most of the audio band.
+ *        This is not a component. For pre-built components which use this kernel, see IIRHilbertApproximator and FrequencyShifter.
+ * 
+ * The two chains are independent, so each chain of each channel is given its own lane and every stage is performed on all of the lanes at once, which the compiler can keep in vector registers.
+ * 
+ * @tparam Lanes The number of channels processed together. The default is 1.
+ */
+template <int Lanes = 1>
+class IIRHilbertKernel
+{
+ static_assert(Lanes > 0, "IIRHilbertKernel: Lanes must be positive");
+ 
+ static constexpr int Stages = 8;
+ static constexpr int ChainLanes = 2*Lanes;
+ 
+ // The first Lanes lanes hold the quadrature chain and the rest hold the in phase chain
+ alignas(32) std::array<std::array<SampleType, ChainLanes>, Stages> coeff;
+ alignas(32) std::array<std::array<SampleType, ChainLanes>, Stages> z1;
+ alignas(32) std::array<std::array<SampleType, ChainLanes>, Stages> z2;
+ alignas(32) std::array<SampleType, Lanes> quadratureDelay;
+ 
+public:
+ IIRHilbertKernel()
+ {
+  static constexpr SampleType quadratureCoefficients[Stages] =
+  {
+   0.999533593f, 0.997023120f, 0.991184054f, 0.975597057f,
+   0.933889435f, 0.827559364f, 0.590957946f, 0.219852059f
+  };
+  static constexpr SampleType inPhaseCoefficients[Stages] =
+  {
+   0.998478404f, 0.994786059f, 0.985287169f, 0.959716311f,
+   0.892466594f, 0.729672406f, 0.413200818f, 0.061990080f
+  };
+  
+  for (int k = 0; k < Stages; ++k)
+  {
+   for (int l = 0; l < Lanes; ++l)
+   {
+    coeff[k][l] = quadratureCoefficients[k];
+    coeff[k][Lanes + l] = inPhaseCoefficients[k];
+   }
+  }
+  
+  reset();
+ }
+ 
+ /**
+  * @brief Reset the kernel.
+  * 
+  */
+ void reset()
+ {
+  for (auto &z : z1) z.fill(0.);
+  for (auto &z : z2) z.fill(0.);
+  quadratureDelay.fill(0.);
+ }
+ 
+ /**
+  * @brief Process a block of input for every lane.
+  * 
+  * The samples of all the lanes are interleaved, so the lanes of sample n start at index n*Lanes. The state of the filters is copied into local variables for the duration of the block, so the compiler can keep it in registers instead of writing every stage out to memory for every sample.
+  * 
+  * @param input The interleaved input samples.
+  * @param inPhase Receives the interleaved in phase output samples.
+  * @param quadrature Receives the interleaved quadrature output samples, which lag the in phase output by 90 degrees.
+  * @param count The number of samples in each lane to process.
+  */
+ void process(const SampleType *input, SampleType *inPhase, SampleType *quadrature, int count)
+ {
+  const auto a = coeff;
+  auto s1 = z1;
+  auto s2 = z2;
+  auto delay = quadratureDelay;
+  
+  for (int n = 0; n < count; ++n)
+  {
+   alignas(32) std::array<SampleType, ChainLanes> x;
+   for (int l = 0; l < Lanes; ++l) x[l] = x[Lanes + l] = input[n*Lanes + l];
+   
+   // Each stage is an all pass filter in z^-2
+   for (int k = 0; k < Stages; ++k)
+   {
+    for (int l = 0; l < ChainLanes; ++l)
+    {
+     const SampleType y = s2[k][l] - a[k][l]*x[l];
+     s2[k][l] = s1[k][l];
+     s1[k][l] = x[l] + a[k][l]*y;
+     x[l] = y;
+    }
+   }
+   
+   for (int l = 0; l < Lanes; ++l)
+   {
+    quadrature[n*Lanes + l] = delay[l];
+    delay[l] = x[l];
+    inPhase[n*Lanes + l] = x[Lanes + l];
+   }
+  }
+  
+  z1 = s1;
+  z2 = s2;
+  quadratureDelay = delay;
+ }
+};
+
+
+
+
+
+
+
+
+
+
+}
+
+#endif /* XDDSP_IIRHilbertKernel_h */
@@ -30,6 +30,7 @@ namespace XDDSP
 
 
 class LinkwitzRileyFilterKernel;
+template <int Lanes> class MultichannelLinkwitzRileyKernel;
 
 
 
@@ -48,6 +49,7 @@ class LinkwitzRileyFilterKernel;
 class LinkwitzRileyFilterCoefficients : public Parameters::ParameterListener
 {
  friend class LinkwitzRileyFilterKernel;
+ template <int Lanes> friend class MultichannelLinkwitzRileyKernel;
  
  Parameters &dspParam;
 
@@ -126,6 +128,18 @@ public:
   fc = frequency;
   setCoeff();
  }
+ 
+ /**
+  * @brief Get the calculated coefficients of one output of the filter.
+  * 
+  * @param highPass Set as true to get the coefficients of the high pass output, or false for the low pass output.
+  * @return std::array<double, 9> The five feedforward coefficients followed by the four feedback coefficients b1 to b4, which are shared by both outputs.
+  */
+ std::array<double, 9> getCoefficients(bool highPass) const
+ {
+  if (highPass) return {ha0, ha1, ha2, ha3, ha4, b1, b2, b3, b4};
+  return {la0, la1, la2, la3, la4, b1, b2, b3, b4};
+ }
 };
 
 
@@ -240,6 +254,100 @@ public:
 
 
 
+/**
+ * @brief A Linkwitz-Riley filter kernel which processes several channels in lockstep with shared coefficients.
+ * 
+ * The state of each channel is held in its own lane of an array, so each step of the filter is performed on every channel at once and the compiler can keep all the lanes in one vector register. The results are the same as one LinkwitzRileyFilterKernel per channel.
+ * 
+ * @tparam Lanes The number of channels processed together. Multiples of 4 make the best use of vector registers.
+ */
+template <int Lanes>
+class MultichannelLinkwitzRileyKernel
+{
+ static_assert(Lanes > 0, "MultichannelLinkwitzRileyKernel: Lanes must be positive");
+ 
+ alignas(32) std::array<SampleType, Lanes> xm1;
+ alignas(32) std::array<SampleType, Lanes> xm2;
+ alignas(32) std::array<SampleType, Lanes> xm3;
+ alignas(32) std::array<SampleType, Lanes> xm4;
+ alignas(32) std::array<SampleType, Lanes> lym1;
+ alignas(32) std::array<SampleType, Lanes> lym2;
+ alignas(32) std::array<SampleType, Lanes> lym3;
+ alignas(32) std::array<SampleType, Lanes> lym4;
+ alignas(32) std::array<SampleType, Lanes> hym1;
+ alignas(32) std::array<SampleType, Lanes> hym2;
+ alignas(32) std::array<SampleType, Lanes> hym3;
+ alignas(32) std::array<SampleType, Lanes> hym4;
+ 
+public:
+ MultichannelLinkwitzRileyKernel()
+ {
+  reset();
+ }
+ 
+ /**
+  * @brief Reset the filter kernel.
+  * 
+  */
+ void reset()
+ {
+  for (auto *a : {&xm1, &xm2, &xm3, &xm4, &lym1, &lym2, &lym3, &lym4, &hym1, &hym2, &hym3, &hym4}) a->fill(0.);
+ }
+ 
+ /**
+  * @brief Process one sample of filter input for every lane.
+  * 
+  * @param coeff The class containing the filter coefficients.
+  * @param lowOutput An array which receives the signals below the cutoff frequency, one sample for each lane.
+  * @param highOutput An array which receives the signals above the cutoff frequency, one sample for each lane.
+  * @param input An array of one input sample for each lane.
+  */
+ void process(const LinkwitzRileyFilterCoefficients &coeff,
+              SampleType *lowOutput,
+              SampleType *highOutput,
+              const SampleType *input)
+ {
+  // The coefficients stay in double precision, as in LinkwitzRileyFilterKernel
+  const double la0 = coeff.la0, la1 = coeff.la1, la2 = coeff.la2, la3 = coeff.la3, la4 = coeff.la4;
+  const double ha0 = coeff.ha0, ha1 = coeff.ha1, ha2 = coeff.ha2, ha3 = coeff.ha3, ha4 = coeff.ha4;
+  const double b1 = coeff.b1, b2 = coeff.b2, b3 = coeff.b3, b4 = coeff.b4;
+  
+  for (int l = 0; l < Lanes; ++l)
+  {
+   const SampleType x = input[l];
+   const SampleType low = la0*x + la1*xm1[l] + la2*xm2[l] + la3*xm3[l] + la4*xm4[l] - b1*lym1[l] - b2*lym2[l] - b3*lym3[l] - b4*lym4[l];
+   const SampleType high = ha0*x + ha1*xm1[l] + ha2*xm2[l] + ha3*xm3[l] + ha4*xm4[l] - b1*hym1[l] - b2*hym2[l] - b3*hym3[l] - b4*hym4[l];
+   
+   lym4[l] = lym3[l];
+   lym3[l] = lym2[l];
+   lym2[l] = lym1[l];
+   lym1[l] = low;
+   
+   hym4[l] = hym3[l];
+   hym3[l] = hym2[l];
+   hym2[l] = hym1[l];
+   hym1[l] = high;
+   
+   xm4[l] = xm3[l];
+   xm3[l] = xm2[l];
+   xm2[l] = xm1[l];
+   xm1[l] = x;
+   
+   lowOutput[l] = low;
+   highOutput[l] = high;
+  }
+ }
+};
+
+
+
+
+
+
+
+
+
+
 }
 
 #endif /* XDDSP_LinkwitzRileyKernel_h */
@@ -283,7 +283,7 @@ public:
   * @tparam SquareInputSignal Set this to 1 to cause the component to square every input value before taking the average.
  */
 template <typename SignalIn, int SquareInputSignal = 0>
-class SignalAverage : public Component<SignalAverage<SignalIn>>, public Parameters::ParameterListener
+class SignalAverage : public Component<SignalAverage<SignalIn, SquareInputSignal>>, public Parameters::ParameterListener
 {
  Parameters &dspParam;
  
@@ -293,6 +293,8 @@ class SignalAverage : public Component<SignalAverage<SignalIn>>, public Paramete
  SampleType recWindowSize;
  
  SampleType maxWindowSize;
+ 
+ static constexpr int BlockSize = 64;
 
 public:
  static constexpr int Count = SignalIn::Count;
@@ -323,7 +325,7 @@ public:
   int iMax = static_cast<int>(maxWindowSize*dspParam.sampleRate());
   for (auto &b : buffer)
   {
-   b.setMaximumLength(iMax);
+   b.setMaximumLength(iMax + BlockSize);
   }
   reset();
  }
@@ -333,7 +335,7 @@ public:
   int iMax = static_cast<int>(maxWindowSize*sr);
   for (auto &b : buffer)
   {
-   b.setMaximumLength(iMax);
+   b.setMaximumLength(iMax + BlockSize);
   }
   reset();
  }
@@ -362,24 +364,42 @@ public:
   }
  }
  
- void reset() override
+ void reset()
  {
   accum.fill(0.);
   for (auto &b : buffer) b.reset(0.);
   signalOut.reset();
  }
  
- void stepProcess(int startPoint, int sampleCount) override
+ void stepProcess(int startPoint, int sampleCount)
  {
+  std::array<SampleType, BlockSize> entering;
+  std::array<SampleType, BlockSize> leaving;
+  
   for (int c = 0; c < Count; ++c)
   {
-   for (int i = startPoint, s = sampleCount; s--; ++i)
+   for (int i = startPoint, s = sampleCount; s > 0;)
    {
-    SampleType ss = signalIn(c, i);
-    if (SquareInputSignal) ss *= ss;
-    accum[c] += buffer[c].tapIn(ss);
-    accum[c] -= buffer[c].tapOut(windowSize);
-    signalOut.buffer(c, i) = accum[c]*recWindowSize;
+    const int n = std::min(s, BlockSize);
+    for (int j = 0; j < n; ++j)
+    {
+     SampleType ss = signalIn(c, i + j);
+     if (SquareInputSignal) ss *= ss;
+     entering[j] = ss;
+    }
+    
+    buffer[c].write(entering.data(), n);
+    buffer[c].read(windowSize, leaving.data(), n);
+    
+    for (int j = 0; j < n; ++j)
+    {
+     accum[c] += entering[j];
+     accum[c] -= leaving[j];
+     signalOut.buffer(c, i + j) = accum[c]*recWindowSize;
+    }
+    
+    i += n;
+    s -= n;
    }
   }
  }
@@ -458,10 +478,7 @@ public:
  {
   vector.resize(bufferSize);
   std::lock_guard lock(mux);
-  for (int i = 0; i < bufferSize; ++i)
-  {
-   vector[i] = buffer[channel].tapOut(bufferSize - i - 1);
-  }
+  buffer[channel].read(0, vector.data(), bufferSize);
  }
  
  /**
@@ -500,10 +517,7 @@ public:
  {
   vector.resize(length);
   std::lock_guard lock(mux);
-  for (int i = 0; i < length; ++i)
-  {
-   vector[i] = buffer[channel].tapOut(bufferSize - i - 1);
-  }
+  buffer[channel].read(bufferSize - length, vector.data(), length);
  }
  
  /**
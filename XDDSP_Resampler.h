@@ -0,0 +1,420 @@
+//
+//  XDDSP_Resampler.h
+//  XDDSP
+//
+
+#ifndef XDDSP_Resampler_h
+#define XDDSP_Resampler_h
+
+#include "XDDSP_Types.h"
+#include "XDDSP_Functions.h"
+#include "XDDSP_Parameters.h"
+#include "XDDSP_Classes.h"
+#include "XDDSP_FIRImpulses.h"
+#include "XDDSP_WindowFunctions.h"
+
+
+
+
+
+
+
+
+
+
+namespace XDDSP
+{
+
+
+
+
+
+
+
+
+
+
+/**
+ * @brief A table of windowed-sinc kernels for resampling by any ratio.
+ * 
+ * The prototype lowpass filter is generated with FIRImpulses::LowPass at a rate many times the input rate, windowed with a Blackman-Harris window and split into phases, one kernel per phase. Samples between the phases are found by interpolating linearly between the results of the two nearest kernels. Each kernel is normalised to unity gain at DC.
+ * 
+ * The quality levels in XDDSP::ProcessQuality select the length of the kernels and the number of phases.
+ */
+class ResamplerKernel
+{
+ int taps {0};
+ int phases {0};
+ std::vector<SampleType> table;
+
+public:
+ /**
+  * @brief Get the length of the kernels used for a quality level.
+  * 
+  * @param quality One of the values in XDDSP::ProcessQuality.
+  * @return int The number of taps in each kernel.
+  */
+ static int tapCount(int quality)
+ {
+  switch (quality)
+  {
+   case ProcessQuality::LowQuality: return 8;
+   case ProcessQuality::MidQuality: return 24;
+   default: return 64;
+  }
+ }
+ 
+ /**
+  * @brief Get the number of phases used for a quality level.
+  * 
+  * @param quality One of the values in XDDSP::ProcessQuality.
+  * @return int The number of phases between two input samples.
+  */
+ static int phaseCount(int quality)
+ {
+  switch (quality)
+  {
+   case ProcessQuality::LowQuality: return 32;
+   case ProcessQuality::MidQuality: return 128;
+   default: return 512;
+  }
+ }
+ 
+ /**
+  * @brief Calculate the kernels. This allocates memory.
+  * 
+  * When the ratio is less than one, the cutoff frequency is lowered to prevent aliasing.
+  * 
+  * @param quality One of the values in XDDSP::ProcessQuality.
+  * @param ratio The output sample rate divided by the input sample rate.
+  */
+ void build(int quality, double ratio)
+ {
+  taps = tapCount(quality);
+  phases = phaseCount(quality);
+  
+  // Place the edge of the transition band of the window close to the Nyquist frequency
+  const int length = taps*phases;
+  const SampleType cutoff = (0.5 - 2./taps)*std::min(1., ratio);
+  std::vector<SampleType> prototype(length + 1);
+  generateImpulseResponse(FIRImpulses::LowPass(length + 1, cutoff/phases), prototype);
+  applyWindowFunction(WindowFunction::BlackmanHarris(length), prototype);
+  
+  // One extra phase so that the last phase can be interpolated with the next input sample
+  table.resize((phases + 1)*taps);
+  for (int p = 0; p <= phases; ++p)
+  {
+   SampleType *row = table.data() + p*taps;
+   SampleType sum = 0.;
+   for (int t = 0; t < taps; ++t)
+   {
+    row[t] = prototype[p + phases*(taps - 1 - t)];
+    sum += row[t];
+   }
+   for (int t = 0; t < taps; ++t) row[t] /= sum;
+  }
+ }
+ 
+ /**
+  * @brief Get the length of the kernels.
+  * 
+  * @return int The number of taps in each kernel.
+  */
+ int getTaps() const
+ { return taps; }
+ 
+ /**
+  * @brief Get the number of input samples a kernel reaches before the interpolated position, which is the latency of a streaming resampler.
+  * 
+  * @return int The number of input samples.
+  */
+ int getPreceding() const
+ { return taps/2 - 1; }
+ 
+ /**
+  * @brief Calculate a sample between two input samples.
+  * 
+  * @param x A pointer to the input samples. The interpolated position is between x[getPreceding()] and the sample after it, and getTaps() samples are read.
+  * @param fraction The position between the two samples, from 0 to 1.
+  * @return SampleType The interpolated sample.
+  */
+ SampleType interpolate(const SampleType *x, SampleType fraction) const
+ {
+  const SampleType phase = fraction*phases;
+  const int p = std::min(phases - 1, static_cast<int>(phase));
+  const SampleType a = phase - p;
+  const SampleType *h0 = table.data() + p*taps;
+  const SampleType *h1 = h0 + taps;
+  
+  const SampleType y0 = sumTerms(taps, [=](int t) { return h0[t]*x[t]; });
+  const SampleType y1 = sumTerms(taps, [=](int t) { return h1[t]*x[t]; });
+  return y0 + a*(y1 - y0);
+ }
+};
+
+
+
+
+
+
+
+
+
+
+/**
+ * @brief Resample a buffer from one sample rate to another, for example to load an impulse response recorded at another rate.
+ * 
+ * The output starts at the same moment as the input, and is as long as the input in time, rounded up to a whole number of output samples. This allocates memory.
+ * 
+ * @param input A pointer to the input samples.
+ * @param inputLength The number of input samples.
+ * @param inputRate The sample rate of the input.
+ * @param outputRate The sample rate of the output.
+ * @param output The vector to write the resampled samples into. It is resized to fit.
+ * @param quality One of the values in XDDSP::ProcessQuality. The default is high quality.
+ */
+inline void resampleBuffer(const SampleType *input,
+                           std::size_t inputLength,
+                           double inputRate,
+                           double outputRate,
+                           std::vector<SampleType> &output,
+                           int quality = ProcessQuality::HighQuality)
+{
+ ResamplerKernel kernel;
+ kernel.build(quality, outputRate/inputRate);
+ 
+ std::vector<SampleType> padded(inputLength + kernel.getTaps(), 0.);
+ std::copy(input, input + inputLength, padded.begin() + kernel.getPreceding());
+ 
+ const double step = inputRate/outputRate;
+ output.resize(static_cast<std::size_t>(std::ceil(inputLength/step)));
+ for (std::size_t m = 0; m < output.size(); ++m)
+ {
+  const double position = m*step;
+  const std::size_t n = static_cast<std::size_t>(position);
+  output[m] = kernel.interpolate(padded.data() + n, position - n);
+ }
+}
+
+/**
+ * @brief Resample a std::vector from one sample rate to another.
+ * 
+ * @param input The input samples.
+ * @param inputRate The sample rate of the input.
+ * @param outputRate The sample rate of the output.
+ * @param output The vector to write the resampled samples into. It is resized to fit.
+ * @param quality One of the values in XDDSP::ProcessQuality. The default is high quality.
+ */
+inline void resampleBuffer(const std::vector<SampleType> &input,
+                           double inputRate,
+                           double outputRate,
+                           std::vector<SampleType> &output,
+                           int quality = ProcessQuality::HighQuality)
+{ resampleBuffer(input.data(), input.size(), inputRate, outputRate, output, quality); }
+
+
+
+
+
+
+
+
+
+
+/**
+ * @brief A component which brings a signal at another sample rate into the DSP network.
+ * 
+ * Samples at the source sample rate are written into the resampler with write, and the resampler outputs them at the sample rate of the DSP network. Before processing each block, call inputRequired to find out how many source samples the block will consume, and write at least that many. If the resampler runs out of source samples, it outputs silence until more are written.
+ * 
+ * The output is delayed by getLatency source samples. All memory is allocated when the sample rates or buffer size change.
+ * 
+ * @tparam ChannelCount The number of channels.
+ * @tparam Quality One of the values in XDDSP::ProcessQuality, selecting the length of the kernel. The default is high quality.
+ */
+template <int ChannelCount = 1, int Quality = ProcessQuality::HighQuality>
+class Resampler : public Component<Resampler<ChannelCount, Quality>>, public Parameters::ParameterListener
+{
+ static_assert(Quality == ProcessQuality::LowQuality ||
+               Quality == ProcessQuality::MidQuality ||
+               Quality == ProcessQuality::HighQuality,
+               "Invalid quality specifier");
+ 
+ Parameters &dspParam;
+ ResamplerKernel kernel;
+ double sourceRate;
+ double step {1.};
+ 
+ // Each channel is a circular buffer with every sample written twice, so that a kernel always reads contiguous samples
+ std::array<std::vector<SampleType>, ChannelCount> fifo;
+ PowerSize fifoSize;
+ uint64_t written {0};
+ uint64_t readIndex {0};
+ double fraction {0.};
+ 
+ void configure()
+ {
+  step = sourceRate*dspParam.sampleInterval();
+  kernel.build(Quality, 1./step);
+  fifoSize.setToNextPowerTwo(2*(static_cast<uint32_t>(std::ceil(dspParam.bufferSize()*step)) + kernel.getTaps()));
+  for (auto &f : fifo) f.assign(2*fifoSize.size(), 0.);
+  reset();
+ }
+
+public:
+ static constexpr int Count = ChannelCount;
+ 
+ Output<Count> signalOut;
+ 
+ /**
+  * @brief Construct a new Resampler object.
+  * 
+  * @param p A parameters object.
+  * @param sourceSampleRate The sample rate of the samples which will be written into the resampler.
+  */
+ Resampler(Parameters &p, double sourceSampleRate) :
+ Parameters::ParameterListener(p),
+ dspParam(p),
+ sourceRate(sourceSampleRate),
+ signalOut(p)
+ {
+  configure();
+ }
+ 
+ virtual void updateSampleRate(double sr, double isr) override
+ { configure(); }
+ 
+ virtual void updateBufferSize(int bs) override
+ { configure(); }
+ 
+ /**
+  * @brief Set the sample rate of the samples written into the resampler. This allocates memory and clears the resampler.
+  * 
+  * @param sourceSampleRate The source sample rate.
+  */
+ void setSourceSampleRate(double sourceSampleRate)
+ {
+  sourceRate = sourceSampleRate;
+  configure();
+ }
+ 
+ /**
+  * @brief Get the sample rate of the samples written into the resampler.
+  * 
+  * @return double The source sample rate.
+  */
+ double getSourceSampleRate() const
+ { return sourceRate; }
+ 
+ /**
+  * @brief Get the delay of the output.
+  * 
+  * @return int The delay in source samples.
+  */
+ int getLatency() const
+ { return kernel.getPreceding() + 1; }
+ 
+ /**
+  * @brief Find out how many more source samples must be written before processing a number of output samples.
+  * 
+  * @param outputSamples The number of samples which will be processed.
+  * @return int The number of source samples to write.
+  */
+ int inputRequired(int outputSamples) const
+ {
+  if (outputSamples <= 0) return 0;
+  uint64_t index = readIndex;
+  double f = fraction;
+  for (int i = 1; i < outputSamples; ++i)
+  {
+   f += step;
+   const int advance = static_cast<int>(f);
+   f -= advance;
+   index += advance;
+  }
+  const uint64_t needed = index + kernel.getTaps();
+  return needed > written ? static_cast<int>(needed - written) : 0;
+ }
+ 
+ /**
+  * @brief Write source samples into the resampler.
+  * 
+  * @param channels An array of pointers to the samples of each channel.
+  * @param count The number of samples in each channel.
+  * @return int The number of samples written, which is less than count if the resampler is full.
+  */
+ int write(const SampleType * const *channels, int count)
+ {
+  const uint64_t space = fifoSize.size() - (written - readIndex);
+  count = static_cast<int>(std::min<uint64_t>(count, space));
+  for (int c = 0; c < Count; ++c)
+  {
+   SampleType *f = fifo[c].data();
+   uint64_t w = written;
+   for (int i = 0; i < count; ++i, ++w)
+   {
+    const uint32_t index = w & fifoSize.mask();
+    f[index] = f[index + fifoSize.size()] = channels[c][i];
+   }
+  }
+  written += count;
+  return count;
+ }
+ 
+ /**
+  * @brief Write source samples from a std::array of pointers into the resampler.
+  * 
+  * @param channels The pointers to the samples of each channel.
+  * @param count The number of samples in each channel.
+  * @return int The number of samples written, which is less than count if the resampler is full.
+  */
+ int write(const std::array<const SampleType*, ChannelCount> &channels, int count)
+ { return write(channels.data(), count); }
+ 
+ void reset()
+ {
+  for (auto &f : fifo) std::fill(f.begin(), f.end(), 0.);
+  
+  // Start with enough silence for the kernel to reach before the first source sample
+  written = kernel.getPreceding();
+  readIndex = 0;
+  fraction = 0.;
+  signalOut.reset();
+ }
+ 
+ void stepProcess(int startPoint, int sampleCount)
+ {
+  const int taps = kernel.getTaps();
+  for (int i = startPoint, s = sampleCount; s--; ++i)
+  {
+   if (written - readIndex < static_cast<uint64_t>(taps))
+   {
+    for (int c = 0; c < Count; ++c) signalOut.buffer(c, i) = 0.;
+    continue;
+   }
+   
+   const uint32_t offset = readIndex & fifoSize.mask();
+   for (int c = 0; c < Count; ++c)
+   {
+    signalOut.buffer(c, i) = kernel.interpolate(fifo[c].data() + offset, fraction);
+   }
+   
+   fraction += step;
+   const int advance = static_cast<int>(fraction);
+   fraction -= advance;
+   readIndex += advance;
+  }
+ }
+};
+
+
+
+
+
+
+
+
+
+
+}
+
+#endif // XDDSP_Resampler_h
@@ -0,0 +1,360 @@
+//
+//  XDDSP_Reverb.h
+//  XDDSP
+//
+
+#ifndef XDDSP_Reverb_h
+#define XDDSP_Reverb_h
+
+#include "XDDSP_CircularBuffer.h"
+
+
+
+
+
+
+
+
+
+
+namespace XDDSP
+{
+
+
+
+
+
+
+
+
+
+/**
+ * @brief Contains the enum which selects the feedback matrix of a FeedbackDelayNetworkReverb.
+ * 
+ * Both matrices are orthogonal, so the network loses no energy through the mixing. Householder mixes every line equally with every other line and costs one sum for each sample. Hadamard spreads the lines with alternating signs, which builds up echo density faster, and costs a fast Walsh-Hadamard transform for each sample.
+ */
+struct FeedbackMatrix
+{
+ enum
+ {
+  Householder = 0,
+  Hadamard
+ };
+};
+
+
+
+
+
+
+
+
+
+
+/**
+ * @brief An algorithmic reverb built from a feedback delay network.
+ * 
+ * The output of every delay line is damped with a one pole lowpass filter, attenuated to give the required decay time, mixed with the other lines through an orthogonal feedback matrix and fed back in along with the input. The length of each delay line is modulated by a slow sine wave, each with its own phase and rate, which smears the resonant modes of the network. The delay line lengths are prime numbers spread between the room size and a little over a third of it.
+ * 
+ * Each channel of the input is fed into every line whose index leaves that channel number as the remainder when divided by the channel count, and each channel of the output is taken from the same lines. Only the reverberated signal is output, so the dry signal should be mixed in separately.
+ * 
+ * Every line is longer than the block size of 32 samples, so the output of the lines is read for a whole block before any of the block is fed back, and the damping, gain and mixing are done across all of the lines at once. The controls are read once at the start of each block.
+ * 
+ * @tparam SignalIn Couples to the input signal. It can have any number of channels up to the number of lines.
+ * @tparam DecayTimeIn Couples to the decay time, which is the time in seconds for the reverb to decay by 60dB. Only one channel is allowed.
+ * @tparam DampingIn Couples to the damping frequency in Hz. Higher frequencies decay faster than the decay time. Only one channel is allowed.
+ * @tparam ModulationDepthIn Couples to the depth of the delay line modulation in samples, up to MaximumModulationDepth. Only one channel is allowed.
+ * @tparam Lines The number of delay lines, which must be a power of two and at least 4. The default is 8.
+ * @tparam Matrix The feedback matrix, one of the values in FeedbackMatrix. The default is FeedbackMatrix::Householder.
+ */
+template <
+typename SignalIn,
+typename DecayTimeIn,
+typename DampingIn,
+typename ModulationDepthIn,
+int Lines = 8,
+int Matrix = FeedbackMatrix::Householder
+>
+class FeedbackDelayNetworkReverb :
+public Component<FeedbackDelayNetworkReverb<SignalIn, DecayTimeIn, DampingIn, ModulationDepthIn, Lines, Matrix>>,
+public Parameters::ParameterListener
+{
+ static_assert(Lines >= 4 && (Lines & (Lines - 1)) == 0, "FeedbackDelayNetworkReverb: Lines must be a power of two, and at least 4");
+ static_assert(SignalIn::Count <= Lines, "FeedbackDelayNetworkReverb: SignalIn can not have more channels than there are lines");
+ static_assert(DecayTimeIn::Count == 1, "FeedbackDelayNetworkReverb: DecayTimeIn is expected to have just one channel");
+ static_assert(DampingIn::Count == 1, "FeedbackDelayNetworkReverb: DampingIn is expected to have just one channel");
+ static_assert(ModulationDepthIn::Count == 1, "FeedbackDelayNetworkReverb: ModulationDepthIn is expected to have just one channel");
+ 
+public:
+ static constexpr int Count = SignalIn::Count;
+ static constexpr int MaximumModulationDepth = 64;
+ 
+private:
+ static constexpr int BlockSize = 32;
+ 
+ // The shortest line has to hold a whole block even when its modulation is at its shortest
+ static constexpr uint32_t MinimumLength = BlockSize + MaximumModulationDepth + 2;
+ 
+ // The length of the shortest line as a proportion of the room size
+ static constexpr SampleType ShortestRatio = 0.37;
+ 
+ Parameters &dspParam;
+ std::array<DynamicCircularBuffer<>, Lines> line;
+ alignas(32) std::array<SampleType, Lines> length;
+ alignas(32) std::array<SampleType, Lines> gain;
+ alignas(32) std::array<SampleType, Lines> damping;
+ alignas(32) std::array<SampleType, Lines> cosPhase;
+ alignas(32) std::array<SampleType, Lines> sinPhase;
+ alignas(32) std::array<SampleType, Lines> cosStep;
+ alignas(32) std::array<SampleType, Lines> sinStep;
+ SampleType roomSize {0.1};
+ SampleType modulationRate {0.5};
+ SampleType decayTime {0.};
+ SampleType dampingFrequency {0.};
+ SampleType dampingCoefficient {0.};
+ 
+ static bool isPrime(uint32_t x)
+ {
+  if (x < 2) return false;
+  for (uint32_t d = 2; d*d <= x; ++d) if (x % d == 0) return false;
+  return true;
+ }
+ 
+ void updateLengths()
+ {
+  const SampleType longest = roomSize*dspParam.sampleRate();
+  for (int l = 0; l < Lines; ++l)
+  {
+   const SampleType ratio = pow(ShortestRatio, static_cast<SampleType>(l)/(Lines - 1));
+   uint32_t samples = std::max(MinimumLength, static_cast<uint32_t>(longest*ratio)) | 1;
+   
+   // Find the next prime length which no other line is using
+   while (!isPrime(samples) || std::find(length.begin(), length.begin() + l, samples) != length.begin() + l) samples += 2;
+   
+   length[l] = samples;
+   line[l].setMaximumLength(samples + MaximumModulationDepth + 2);
+   line[l].reset(0.);
+  }
+  
+  // Make sure that the gains are recalculated for the new lengths
+  decayTime = 0.;
+ }
+ 
+ void updateModulation()
+ {
+  // The rates are spread a little so that the lines never modulate in step
+  for (int l = 0; l < Lines; ++l)
+  {
+   const SampleType rate = modulationRate*(1. + 0.5*l/Lines);
+   const SampleType w = 2.*M_PI*rate*dspParam.sampleInterval();
+   cosStep[l] = cos(w);
+   sinStep[l] = sin(w);
+  }
+ }
+ 
+ void updateControls(int i)
+ {
+  const SampleType t60 = fastMax(decayTimeIn(0, i), 0.01);
+  if (t60 != decayTime)
+  {
+   decayTime = t60;
+   const SampleType k = -6.907755278982137*dspParam.sampleInterval()/t60;
+   for (int l = 0; l < Lines; ++l) gain[l] = exp(k*length[l]);
+  }
+  
+  const SampleType fc = fastBoundary(dampingIn(0, i), 10., 0.49*dspParam.sampleRate());
+  if (fc != dampingFrequency)
+  {
+   dampingFrequency = fc;
+   dampingCoefficient = exp(-2.*M_PI*fc*dspParam.sampleInterval());
+  }
+ }
+ 
+ static void mix(SampleType *v)
+ {
+  if constexpr (Matrix == FeedbackMatrix::Hadamard)
+  {
+   for (int h = 1; h < Lines; h *= 2)
+   {
+    for (int a = 0; a < Lines; a += 2*h)
+    {
+     for (int b = a; b < a + h; ++b)
+     {
+      const SampleType x = v[b];
+      const SampleType y = v[b + h];
+      v[b] = x + y;
+      v[b + h] = x - y;
+     }
+    }
+   }
+   
+   const SampleType scale = 1./sqrt(static_cast<SampleType>(Lines));
+   for (int l = 0; l < Lines; ++l) v[l] *= scale;
+  }
+  else
+  {
+   SampleType sum = 0.;
+   for (int l = 0; l < Lines; ++l) sum += v[l];
+   sum *= 2./Lines;
+   for (int l = 0; l < Lines; ++l) v[l] -= sum;
+  }
+ }
+ 
+public:
+ // The input signal
+ SignalIn signalIn;
+ 
+ // The decay time in seconds
+ DecayTimeIn decayTimeIn;
+ 
+ // The damping frequency in Hz
+ DampingIn dampingIn;
+ 
+ // The modulation depth in samples
+ ModulationDepthIn modulationDepthIn;
+ 
+ // The reverberated signal
+ Output<Count> signalOut;
+ 
+ FeedbackDelayNetworkReverb(Parameters &p,
+                            SignalIn signalIn,
+                            DecayTimeIn decayTimeIn,
+                            DampingIn dampingIn,
+                            ModulationDepthIn modulationDepthIn) :
+ Parameters::ParameterListener(p),
+ dspParam(p),
+ signalIn(signalIn),
+ decayTimeIn(decayTimeIn),
+ dampingIn(dampingIn),
+ modulationDepthIn(modulationDepthIn),
+ signalOut(p)
+ {
+  length.fill(0.);
+  updateLengths();
+  updateModulation();
+  reset();
+ }
+ 
+ virtual void updateSampleRate(double sr, double isr) override
+ {
+  updateLengths();
+  updateModulation();
+ }
+ 
+ void reset()
+ {
+  for (auto& b : line) b.reset(0.);
+  damping.fill(0.);
+  for (int l = 0; l < Lines; ++l)
+  {
+   cosPhase[l] = cos(2.*M_PI*l/Lines);
+   sinPhase[l] = sin(2.*M_PI*l/Lines);
+  }
+  signalOut.reset();
+ }
+ 
+ /**
+  * @brief Set the size of the room, which is the length of the longest delay line in seconds.
+  * 
+  * This allocates memory for the delay lines and clears the reverb tail, so it should not be called while audio is being processed.
+  * 
+  * @param seconds The length of the longest delay line in seconds. The default is 0.1.
+  */
+ void setRoomSize(SampleType seconds)
+ {
+  roomSize = seconds;
+  updateLengths();
+ }
+ 
+ /**
+  * @brief Set the rate of the delay line modulation.
+  * 
+  * @param hz The rate of the slowest line in Hz. The other lines are up to half as fast again. The default is 0.5.
+  */
+ void setModulationRate(SampleType hz)
+ {
+  modulationRate = hz;
+  updateModulation();
+ }
+ 
+ void stepProcess(int startPoint, int sampleCount)
+ {
+  alignas(32) std::array<SampleType, BlockSize*Lines> y;
+  alignas(32) std::array<SampleType, BlockSize> x;
+  const SampleType outputGain = sqrt(static_cast<SampleType>(Count)/Lines);
+  
+  for (int i = startPoint, s = sampleCount; s > 0;)
+  {
+   const int n = std::min(s, BlockSize);
+   updateControls(i);
+   const SampleType depth = fastBoundary(modulationDepthIn(0, i), 0., MaximumModulationDepth);
+   
+   // Read the output of every line for the whole block, with linear interpolation between the taps
+   for (int l = 0; l < Lines; ++l)
+   {
+    SampleType cp = cosPhase[l];
+    SampleType sp = sinPhase[l];
+    for (int j = 0; j < n; ++j)
+    {
+     IntegerAndFraction iaf(length[l] + depth*sp);
+     const int tap = iaf.intRep() - j - 1;
+     y[j*Lines + l] = LERP(iaf.fracPart(), line[l].tapOut(tap), line[l].tapOut(tap + 1));
+     
+     const SampleType c = cp*cosStep[l] - sp*sinStep[l];
+     sp = sp*cosStep[l] + cp*sinStep[l];
+     cp = c;
+    }
+    
+    // Pull the length of the phasor back towards 1 to stop rounding errors from building up
+    const SampleType g = 1.5 - 0.5*(cp*cp + sp*sp);
+    cosPhase[l] = cp*g;
+    sinPhase[l] = sp*g;
+   }
+   
+   auto z = damping;
+   const SampleType a = dampingCoefficient;
+   for (int j = 0; j < n; ++j)
+   {
+    SampleType *v = y.data() + j*Lines;
+    for (int l = 0; l < Lines; ++l)
+    {
+     z[l] = std::fma(z[l] - v[l], a, v[l]);
+     v[l] = gain[l]*z[l];
+    }
+    
+    for (int c = 0; c < Count; ++c)
+    {
+     SampleType sum = 0.;
+     for (int l = c; l < Lines; l += Count) sum += v[l];
+     signalOut.buffer(c, i + j) = outputGain*sum;
+    }
+    
+    mix(v);
+    for (int l = 0; l < Lines; ++l) v[l] += signalIn(l % Count, i + j);
+   }
+   damping = z;
+   
+   for (int l = 0; l < Lines; ++l)
+   {
+    for (int j = 0; j < n; ++j) x[j] = y[j*Lines + l];
+    line[l].write(x.data(), n);
+   }
+   
+   i += n;
+   s -= n;
+  }
+ }
+};
+
+
+
+
+
+
+
+
+
+
+}
+
+#endif /* XDDSP_Reverb_h */
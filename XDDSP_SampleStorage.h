@@ -0,0 +1,140 @@
+//
+//  XDDSP_SampleStorage.h
+//  XDDSP
+//
+
+#ifndef XDDSP_SampleStorage_h
+#define XDDSP_SampleStorage_h
+
+#include "XDDSP_Types.h"
+#include "XDDSP_Functions.h"
+
+
+
+
+
+
+
+
+
+
+namespace XDDSP
+{
+
+
+
+
+
+
+
+
+
+
+/**
+ * @brief A sample stored as an IEEE 754 half precision float, which takes half of the memory of a single precision float.
+ *        It can be used as the element type of a circular buffer, such as DynamicCircularBuffer<HalfSample>, which can then be used as the BufferType of any of the delay components.
+ * 
+ * Half precision keeps 11 significant bits, so each sample is stored with a relative error of at most 2^-12. Measured with a sine wave, this keeps the noise between 73dB and 75.5dB below the signal, depending on where the peak level falls within an octave. This holds for any level down to about 6e-5, or -84dBFS. Below that the steps stay at 6e-8, or -144dBFS, so the noise no longer falls with the signal.
+ * 
+ * The largest value that can be stored is 65504. Samples of 65520 or more are stored as infinity, which reads back as 65536, so they are clipped there. Infinity and NaN are not preserved.
+ */
+class HalfSample
+{
+ uint16_t bits;
+ 
+public:
+ HalfSample() = default;
+ 
+ HalfSample(SampleType x) :
+ bits(floatToHalf(static_cast<float>(x)))
+ {}
+ 
+ operator SampleType() const
+ { return halfToFloat(bits); }
+};
+
+
+
+
+
+
+
+
+
+
+/**
+ * @brief A sample stored as a 16 bit integer where 1 is full scale, which takes half of the memory of a single precision float.
+ *        It can be used as the element type of a circular buffer, such as DynamicCircularBuffer<Int16Sample>, which can then be used as the BufferType of any of the delay components.
+ * 
+ * Samples are rounded to the nearest step of 1/32767, which puts the noise floor about 98dB below a full scale sine wave. Samples outside of the range -1 to 1 are clipped, so this suits signals which are already limited to full scale, such as the recordings in a looper, better than the inside of a feedback loop.
+ */
+class Int16Sample
+{
+ int16_t value;
+ 
+public:
+ Int16Sample() = default;
+ 
+ Int16Sample(SampleType x)
+ {
+  const SampleType y = fastClip(x, 1.)*32767.;
+  value = static_cast<int16_t>(y + std::copysign(static_cast<SampleType>(0.5), y));
+ }
+ 
+ operator SampleType() const
+ { return value*static_cast<SampleType>(1./32767.); }
+};
+
+
+
+
+
+
+
+
+
+
+/**
+ * @brief A sample stored as a 24 bit integer packed into three bytes, where 1 is full scale, which takes three quarters of the memory of a single precision float.
+ *        It can be used as the element type of a circular buffer, such as DynamicCircularBuffer<PackedInt24Sample>, which can then be used as the BufferType of any of the delay components.
+ * 
+ * Samples are rounded to the nearest step of 1/8388607, which puts the noise floor about 145dB below a full scale sine wave once converted back to SampleType, well below the noise of any analogue recording. Samples outside of the range -1 to 1 are clipped.
+ */
+class PackedInt24Sample
+{
+ std::array<uint8_t, 3> bytes;
+ 
+public:
+ PackedInt24Sample() = default;
+ 
+ PackedInt24Sample(SampleType x)
+ {
+  const SampleType y = fastClip(x, 1.)*8388607.;
+  const int32_t v = static_cast<int32_t>(y + std::copysign(static_cast<SampleType>(0.5), y));
+  bytes[0] = static_cast<uint8_t>(v);
+  bytes[1] = static_cast<uint8_t>(v >> 8);
+  bytes[2] = static_cast<uint8_t>(v >> 16);
+ }
+ 
+ operator SampleType() const
+ {
+  // Assemble the bytes at the top of a 32 bit word, then shift back down to extend the sign
+  const uint32_t u = (static_cast<uint32_t>(bytes[0]) << 8) | (static_cast<uint32_t>(bytes[1]) << 16) | (static_cast<uint32_t>(bytes[2]) << 24);
+  return (static_cast<int32_t>(u) >> 8)*static_cast<SampleType>(1./8388607.);
+ }
+};
+
+static_assert(sizeof(PackedInt24Sample) == 3, "PackedInt24Sample: Samples must be packed into three bytes");
+
+
+
+
+
+
+
+
+
+
+}
+
+#endif /* XDDSP_SampleStorage_h */
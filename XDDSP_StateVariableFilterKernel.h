@@ -0,0 +1,139 @@
+//
+//  XDDSP_StateVariableFilterKernel.h
+//  XDDSP
+//
+
+#ifndef XDDSP_StateVariableFilterKernel_h
+#define XDDSP_StateVariableFilterKernel_h
+
+#include "XDDSP_Functions.h"
+
+
+
+
+
+
+
+
+
+
+namespace XDDSP
+{
+
+
+
+
+
+
+
+
+
+
+/**
+ * @brief A state variable filter kernel using the topology-preserving transform, with zero-delay feedback.
+ *        This is not a component. For a pre-built component which uses this filter, see StateVariableFilter.
+ * 
+ * The filter remains stable and free of artifacts when its frequency and resonance change every sample, which makes it suitable for heavily modulated filters such as those in synthesiser voices. The coefficients are cheap to calculate, needing only one tangent, which can be approximated with fastTan.
+ * 
+ * Several channels can be processed together, each in its own lane with its own coefficients, so the compiler can process all of the lanes at once in vector registers.
+ * 
+ * @tparam Lanes The number of channels processed together. The default is 1.
+ */
+template <int Lanes = 1>
+class StateVariableFilterKernel
+{
+ static_assert(Lanes > 0, "StateVariableFilterKernel: Lanes must be positive");
+ 
+ alignas(32) std::array<SampleType, Lanes> ic1;
+ alignas(32) std::array<SampleType, Lanes> ic2;
+
+public:
+ StateVariableFilterKernel()
+ {
+  reset();
+ }
+ 
+ /**
+  * @brief Calculate the frequency coefficient of the filter.
+  * 
+  * @param frequency The cutoff frequency in Hz.
+  * @param sampleInterval The sample interval in seconds.
+  * @return SampleType The frequency coefficient, which is the prewarped gain of the integrators.
+  */
+ static SampleType frequencyCoefficient(SampleType frequency, SampleType sampleInterval)
+ {
+  const SampleType w = fastBoundary(frequency*sampleInterval, 1e-5, 0.49);
+  return fastTan(M_PI*w);
+ }
+ 
+ /**
+  * @brief Calculate the damping coefficient of the filter.
+  * 
+  * @param q The quality factor of the filter.
+  * @return SampleType The damping coefficient.
+  */
+ static SampleType dampingCoefficient(SampleType q)
+ {
+  return 1./fastMax(q, 0.025);
+ }
+ 
+ /**
+  * @brief Reset the filter.
+  * 
+  */
+ void reset()
+ {
+  ic1.fill(0.);
+  ic2.fill(0.);
+ }
+ 
+ /**
+  * @brief Process one sample of input for every lane.
+  * 
+  * The band pass output has unity gain at the cutoff frequency. The notch output is the sum of the low pass and high pass outputs.
+  * 
+  * @param g The frequency coefficient of each lane. See frequencyCoefficient.
+  * @param k The damping coefficient of each lane. See dampingCoefficient.
+  * @param input One input sample for each lane.
+  * @param lowPass Receives one low pass output sample for each lane.
+  * @param bandPass Receives one band pass output sample for each lane.
+  * @param highPass Receives one high pass output sample for each lane.
+  */
+ void process(const SampleType *g,
+              const SampleType *k,
+              const SampleType *input,
+              SampleType *lowPass,
+              SampleType *bandPass,
+              SampleType *highPass)
+ {
+  for (int l = 0; l < Lanes; ++l)
+  {
+   const SampleType a1 = 1./(1. + g[l]*(g[l] + k[l]));
+   const SampleType a2 = g[l]*a1;
+   const SampleType a3 = g[l]*a2;
+   
+   const SampleType v3 = input[l] - ic2[l];
+   const SampleType v1 = a1*ic1[l] + a2*v3;
+   const SampleType v2 = ic2[l] + a2*ic1[l] + a3*v3;
+   ic1[l] = 2.*v1 - ic1[l];
+   ic2[l] = 2.*v2 - ic2[l];
+   
+   lowPass[l] = v2;
+   bandPass[l] = k[l]*v1;
+   highPass[l] = input[l] - k[l]*v1 - v2;
+  }
+ }
+};
+
+
+
+
+
+
+
+
+
+
+}
+
+#endif /* XDDSP_StateVariableFilterKernel_h */
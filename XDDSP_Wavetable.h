@@ -0,0 +1,379 @@
+//
+//  XDDSP_Wavetable.h
+//  XDDSP
+//
+
+#ifndef XDDSP_Wavetable_h
+#define XDDSP_Wavetable_h
+
+#include "XDDSP_Types.h"
+#include "XDDSP_Functions.h"
+#include "XDDSP_Parameters.h"
+#include "XDDSP_Classes.h"
+#include "XDDSP_FFT.h"
+#include <memory>
+
+
+
+
+
+
+
+
+
+
+namespace XDDSP
+{
+
+
+
+
+
+
+
+
+
+
+/**
+ * @brief A set of band-limited wavetables for WavetableOscillator, made from one or more single cycle waveforms called frames.
+ * 
+ * Each frame is stored at a number of mipmap levels, one for each octave. Level 0 keeps every harmonic that the frame size can hold, and each level after that keeps half as many harmonics as the level before, down to the last level which is a pure sine wave. The levels are made by taking the FFT of each frame, removing the harmonics above the limit of the level and taking the inverse FFT.
+ * 
+ * The tables are calculated once on construction and never change after that, so one wavetable can be shared by any number of oscillators on any number of threads. Oscillators hold wavetables with std::shared_ptr, so a wavetable made once with std::make_shared is reference counted and shared by every voice and instance that uses it, instead of each of them holding their own copy.
+ * 
+ * There is one level for each octave from frameSize/2 harmonics down to 1, and every level of every frame is stored at the full frame size plus one guard sample, so a wavetable uses log2(frameSize)*frameCount*(frameSize + 1) samples of memory. A single 2048 sample frame takes 11 levels, or about 90KB with a single precision SampleType.
+ */
+class Wavetable
+{
+ int size;
+ int frames;
+ int levels;
+ std::vector<SampleType> table;
+ 
+ void calculate(const SampleType *waveform)
+ {
+  dsp_assert(size >= 4 && (size & (size - 1)) == 0);
+  dsp_assert(frames > 0);
+  
+  levels = 0;
+  for (int h = size/2; h >= 1; h >>= 1) ++levels;
+  table.assign(static_cast<size_t>(levels)*frames*(size + 1), 0.);
+  
+  FFTPlan plan(size);
+  std::vector<SampleType> spectrum(size);
+  std::vector<SampleType> level(size);
+  
+  for (int f = 0; f < frames; ++f)
+  {
+   std::copy(waveform + f*size, waveform + (f + 1)*size, spectrum.begin());
+   plan.forward(spectrum.data());
+   
+   for (int l = 0; l < levels; ++l)
+   {
+    // Real parts are in the first half of the spectrum and imaginary parts run backwards in the second half
+    const int harmonics = (size/2) >> l;
+    level = spectrum;
+    for (int k = harmonics + 1; k <= size/2; ++k)
+    {
+     level[k] = 0.;
+     if (k < size/2) level[size - k] = 0.;
+    }
+    if (harmonics == size/2) level[size/2] = 0.;
+    plan.inverse(level.data());
+    
+    // Each table has one extra sample at the end which repeats the first, so that interpolation never needs to wrap
+    SampleType *t = table.data() + (static_cast<size_t>(l)*frames + f)*(size + 1);
+    std::copy(level.begin(), level.end(), t);
+    t[size] = t[0];
+   }
+  }
+ }
+ 
+public:
+ /**
+  * @brief Construct a new Wavetable object from an array of frames.
+  *        This allocates memory and takes the FFT of every frame, so it should not be done while audio is being processed.
+  * 
+  * @param waveform The frames, one after the other, each frameSize samples long.
+  * @param frameSize The number of samples in each frame. Must be a power of 2. A size of 2048 keeps every harmonic down to about 23Hz at a sample rate of 48kHz.
+  * @param frameCount The number of frames.
+  */
+ Wavetable(const SampleType *waveform, int frameSize, int frameCount = 1) :
+ size(frameSize),
+ frames(frameCount)
+ {
+  calculate(waveform);
+ }
+ 
+ /**
+  * @brief Construct a new Wavetable object with a single frame calculated from a function, which is called with a value between 0 and 1, as with FuncOscillator.
+  *        This allocates memory and takes the FFT of the frame, so it should not be done while audio is being processed.
+  * 
+  * @param func The function which produces the waveform.
+  * @param frameSize The number of samples in the frame. Must be a power of 2. The default is 2048.
+  */
+ Wavetable(WaveformFunction func, int frameSize = 2048) :
+ size(frameSize),
+ frames(1)
+ {
+  std::vector<SampleType> waveform(size);
+  for (int i = 0; i < size; ++i) waveform[i] = func(static_cast<SampleType>(i)/size);
+  calculate(waveform.data());
+ }
+ 
+ /**
+  * @brief Return a wavetable holding a sine wave, which is made the first time this is called and shared by every caller after that.
+  * 
+  * @return std::shared_ptr<const Wavetable> The sine wavetable.
+  */
+ static std::shared_ptr<const Wavetable> sine()
+ {
+  static const std::shared_ptr<const Wavetable> s = std::make_shared<const Wavetable>([](SampleType x) { return sin(2.*M_PI*x); });
+  return s;
+ }
+ 
+ /**
+  * @brief Return the number of samples in each frame.
+  * 
+  * @return int The frame size.
+  */
+ int getFrameSize() const
+ { return size; }
+ 
+ /**
+  * @brief Return the number of frames.
+  * 
+  * @return int The number of frames.
+  */
+ int getFrameCount() const
+ { return frames; }
+ 
+ /**
+  * @brief Return the number of mipmap levels.
+  * 
+  * @return int The number of levels.
+  */
+ int getLevelCount() const
+ { return levels; }
+ 
+ /**
+  * @brief Return the highest harmonic kept at level 0, from which the level for any frequency is found. The highest harmonic kept at level n is this shifted right by n.
+  * 
+  * @return int The highest harmonic at level 0.
+  */
+ int getHarmonics() const
+ { return size/2; }
+ 
+ /**
+  * @brief Return a pointer to one level of one frame. The table has getFrameSize() + 1 samples, the last of which repeats the first.
+  * 
+  * @param level The mipmap level.
+  * @param frame The frame.
+  * @return const SampleType* The table.
+  */
+ const SampleType* getTable(int level, int frame) const
+ {
+  dsp_assert(level >= 0 && level < levels && frame >= 0 && frame < frames);
+  return table.data() + (static_cast<size_t>(level)*frames + frame)*(size + 1);
+ }
+};
+
+
+
+
+
+
+
+
+
+
+/**
+ * @brief A multi-channel wavetable oscillator which reads band-limited tables from a shared Wavetable.
+ * 
+ * The mipmap level is chosen from the frequency of each channel so that every harmonic played is below half of the sample rate, and the oscillator crossfades between neighbouring levels across each octave so that harmonics fade out smoothly as the frequency rises instead of switching off. Depending on where the frequency sits within the octave, the highest harmonic played is between a quarter and a half of the sample rate. Within a table the samples are linearly interpolated, and the frame input morphs between neighbouring frames with a linear crossfade.
+ * 
+ * The oscillator starts with a shared sine wavetable. Use setWavetable to give it another one, which is usually made once with std::make_shared and given to every oscillator that needs it.
+ * 
+ * @tparam FrequencyIn Couples to a frequency in Hz. This can have as many channels as you like.
+ * @tparam FrameIn Couples to the frame position between 0 and 1, where 0 plays the first frame and 1 plays the last. Must have either one channel or the same number of channels as FrequencyIn.
+ */
+template <typename FrequencyIn, typename FrameIn>
+class WavetableOscillator : public Component<WavetableOscillator<FrequencyIn, FrameIn>>
+{
+ static_assert(FrameIn::Count == 1 || FrameIn::Count == FrequencyIn::Count, "WavetableOscillator: FrameIn must either have one channel or the same number of channels as FrequencyIn");
+ 
+public:
+ static constexpr int Count = FrequencyIn::Count;
+ 
+private:
+ static constexpr bool MultiFrame = FrameIn::Count > 1;
+ 
+ Parameters &dspParam;
+ 
+ std::shared_ptr<const Wavetable> wavetable;
+ std::array<SampleType, Count> phase;
+ 
+ static SampleType readTable(const SampleType *t, int index, SampleType fraction)
+ {
+  return LERP(fraction, t[index], t[index + 1]);
+ }
+ 
+public:
+ FrequencyIn frequencyIn;
+ FrameIn frameIn;
+ 
+ Output<Count> signalOut;
+ 
+ WavetableOscillator(Parameters &p, FrequencyIn _frequencyIn, FrameIn _frameIn) :
+ dspParam(p),
+ wavetable(Wavetable::sine()),
+ frequencyIn(_frequencyIn),
+ frameIn(_frameIn),
+ signalOut(p)
+ {
+  phase.fill(0.);
+ }
+ 
+ void reset()
+ {
+  phase.fill(0.);
+  signalOut.reset();
+ }
+ 
+ /**
+  * @brief Set the wavetable to play. The oscillator shares the wavetable with anything else holding it.
+  *        The wavetable must not be changed while the oscillator is being processed on another thread.
+  * 
+  * @param table The wavetable to play.
+  */
+ void setWavetable(std::shared_ptr<const Wavetable> table)
+ {
+  dsp_assert(table != nullptr);
+  wavetable = std::move(table);
+ }
+ 
+ /**
+  * @brief Return the wavetable being played.
+  * 
+  * @return std::shared_ptr<const Wavetable> The wavetable.
+  */
+ std::shared_ptr<const Wavetable> getWavetable() const
+ { return wavetable; }
+ 
+ /**
+  * @brief Set the phase of the oscillator on one channel.
+  * 
+  * @param channel The channel index of the oscillator to set.
+  * @param _phase The new phase of the oscialltor.
+  */
+ void setPhase(int channel, SampleType _phase)
+ {
+  phase[channel] = _phase - floor(_phase);
+ }
+ 
+ /**
+  * @brief Set the phase of every oscillator.
+  * 
+  * @param _phase The new phase of every oscillator.
+  */
+ void setPhase(SampleType _phase)
+ {
+  for (auto &p : phase) p = _phase - floor(_phase);
+ }
+ 
+ void stepProcess(int startPoint, int sampleCount)
+ {
+  const Wavetable &w = *wavetable;
+  const int size = w.getFrameSize();
+  const int lastFrame = w.getFrameCount() - 1;
+  const int lastLevel = w.getLevelCount() - 1;
+  
+  // The level position is 0 where the highest harmonic of level 0 is a quarter of the sample rate, and rises by 1 for each octave above that
+  const SampleType levelScale = 4.*w.getHarmonics();
+  
+  for (int c = 0; c < Count; ++c)
+  {
+   // The tables are only looked up again when the frequency or the frame changes, which is rarely for most signals
+   SampleType lastStep = -1.;
+   SampleType lastFramePosition = -1.;
+   int level = 0;
+   SampleType levelFade = 0.;
+   int f0 = 0;
+   int f1 = 0;
+   SampleType frameFade = 0.;
+   const SampleType *t00 = nullptr;
+   const SampleType *t01 = nullptr;
+   const SampleType *t10 = nullptr;
+   const SampleType *t11 = nullptr;
+   
+   for (int i = startPoint, s = sampleCount; s--; ++i)
+   {
+    const SampleType ppStep = fastBoundary(frequencyIn(c, i)*dspParam.sampleInterval(), 0., 0.5);
+    const SampleType framePosition = fastBoundary(frameIn(MultiFrame ? c : 0, i), 0., 1.)*lastFrame;
+    
+    if (ppStep != lastStep || framePosition != lastFramePosition)
+    {
+     if (ppStep != lastStep)
+     {
+      lastStep = ppStep;
+      level = 0;
+      levelFade = 0.;
+      const SampleType v = levelScale*ppStep;
+      if (v > 1.)
+      {
+       // frexp splits v into a mantissa between 0.5 and 1 and an exponent, which give the position within the octave and the octave
+       int e;
+       const SampleType m = frexp(v, &e);
+       level = e - 1;
+       levelFade = 2.*m - 1.;
+       if (level >= lastLevel)
+       {
+        level = lastLevel;
+        levelFade = 0.;
+       }
+      }
+     }
+     
+     if (framePosition != lastFramePosition)
+     {
+      lastFramePosition = framePosition;
+      IntegerAndFraction frame(framePosition);
+      f0 = frame.intRep();
+      f1 = std::min(f0 + 1, lastFrame);
+      frameFade = frame.fracPart();
+     }
+     
+     const int nextLevel = std::min(level + 1, lastLevel);
+     t00 = w.getTable(level, f0);
+     t01 = w.getTable(level, f1);
+     t10 = w.getTable(nextLevel, f0);
+     t11 = w.getTable(nextLevel, f1);
+    }
+    
+    IntegerAndFraction position(phase[c]*size);
+    const int index = position.intRep();
+    const SampleType fraction = position.fracPart();
+    
+    const SampleType y0 = LERP(frameFade, readTable(t00, index, fraction), readTable(t01, index, fraction));
+    const SampleType y1 = LERP(frameFade, readTable(t10, index, fraction), readTable(t11, index, fraction));
+    signalOut.buffer(c, i) = LERP(levelFade, y0, y1);
+    
+    phase[c] += ppStep;
+    phase[c] -= floor(phase[c]);
+   }
+  }
+ }
+};
+
+
+
+
+
+
+
+
+
+
+}
+
+#endif /* XDDSP_Wavetable_h */
@@ -157,6 +157,47 @@ public:
 
 
 
+/**
+ * @brief A callable class which produces a Hann window.
+ * 
+ */
+class Hann : public Rectangle
+{
+public:
+ Hann(SampleType length) :
+ Rectangle(length)
+ {}
+ 
+ constexpr SampleType operator()(SampleType x)
+ { return (0.5 - 0.5*cos(2.*M_PI*x/length))*window(x); }
+};
+
+
+
+
+
+/**
+ * @brief A callable class which produces a four term Blackman-Harris window, which has very low sidelobes.
+ * 
+ */
+class BlackmanHarris : public Rectangle
+{
+public:
+ BlackmanHarris(SampleType length) :
+ Rectangle(length)
+ {}
+ 
+ constexpr SampleType operator()(SampleType x)
+ {
+  const SampleType w = 2.*M_PI*x/length;
+  return (0.35875 - 0.48829*cos(w) + 0.14128*cos(2.*w) - 0.01168*cos(3.*w))*window(x);
+ }
+};
+
+
+
+
+
 /**
  * @brief Produce a Gauss window.
  * 